@@ -35,6 +35,7 @@
 # include "System/array.h"
 # include "System/buffer.h"
 # include "System/config.h"
+# include "System/deque.h"
 # include "System/error.h"
 # include "System/event.h"
 # include "System/file.h"
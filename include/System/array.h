@@ -47,32 +47,116 @@ extern "C" {
 	typedef struct _Array type ## Array; \
 	static Array * type ## array_new(void) __attribute__ ((unused)); \
 	static Array * type ## array_new(void) \
-		{ return array_new(sizeof(type)); }
+		{ return array_new(sizeof(type)); } \
+	ARRAY_ACCESSORS(type, type)
 # define ARRAY2(type, name) \
 	typedef struct _Array name ## Array; \
 	static Array * name ## array_new(void) __attribute__ ((unused)); \
 	static Array * name ## array_new(void) \
-		{ return array_new(sizeof(type)); }
+		{ return array_new(sizeof(type)); } \
+	ARRAY_ACCESSORS(type, name)
 # define ARRAY3(type, name, prefix) \
 	typedef struct _Array prefix ## Array; \
 	static Array * name ## array_new(void) __attribute__ ((unused)); \
 	static Array * name ## array_new(void) \
-		{ return array_new(sizeof(type)); }
+		{ return array_new(sizeof(type)); } \
+	ARRAY_ACCESSORS(type, name)
+/* whether the storage is not shared with any copy */
+# define ARRAY_IS_EXCLUSIVE(array) \
+	((array)->value == NULL || __atomic_load_n( \
+		&((ArrayHeader const *)(array)->value)[-1].refcount, \
+		__ATOMIC_SEQ_CST) == 1)
+/* typed accessors, copying the elements by value */
+# define ARRAY_ACCESSORS(type, name) \
+	static inline type const * name ## array_data(Array const * array) \
+		{ return (array->count > 0) ? (type const *)array->value \
+			: NULL; } \
+	static inline type * name ## array_data_mutable(Array * array) \
+		{ return (type *)array_get_data_mutable(array, NULL); } \
+	static inline type * name ## array_get(Array const * array, \
+			size_t pos) \
+		{ return (pos < array->count) \
+			? &((type *)array->value)[pos] : NULL; } \
+	static inline type const * name ## array_get_const( \
+			Array const * array, size_t pos) \
+		{ return (pos < array->count) \
+			? &((type const *)array->value)[pos] : NULL; } \
+	static inline type * name ## array_get_mutable(Array * array, \
+			size_t pos) \
+		{ return (type *)array_get_mutable(array, pos); } \
+	static inline ArrayError name ## array_get_copy(Array const * array, \
+			size_t pos, type * value) \
+	{ \
+		if(pos >= array->count) \
+			return array_get_copy(array, pos, value); \
+		*value = ((type const *)array->value)[pos]; \
+		return 0; \
+	} \
+	static inline ArrayError name ## array_set(Array * array, size_t pos, \
+			type value) \
+	{ \
+		if(pos >= array->count || !ARRAY_IS_EXCLUSIVE(array)) \
+			return array_set(array, pos, &value); \
+		((type *)array->value)[pos] = value; \
+		return 0; \
+	} \
+	static inline ArrayError name ## array_append(Array * array, \
+			type value) \
+	{ \
+		if(array->count >= array->capacity \
+				|| !ARRAY_IS_EXCLUSIVE(array)) \
+			return array_append(array, &value); \
+		((type *)array->value)[array->count++] = value; \
+		return 0; \
+	}
 
 
 /* types */
 typedef struct _Array Array;
+
+/* protected */
+/* part of the ABI for the sake of the inlined typed accessors: changing the
+ * layout of these structures requires bumping the soname */
+/* the storage is shared between copies until either is modified */
+typedef union _ArrayHeader
+{
+	size_t refcount;
+	max_align_t align;
+} ArrayHeader;
+
+struct _Array
+{
+	size_t count;
+	size_t capacity;
+	size_t size;
+	/* preceded by an ArrayHeader unless NULL */
+	char * value;
+};
 typedef void ArrayData;
 typedef int ArrayError;
 
+/* read-only window on the elements, invalidated by any modification */
+typedef struct _ArrayView
+{
+	ArrayData const * data;
+	size_t count;
+	size_t size;
+} ArrayView;
+
+typedef int (*ArrayCompare)(ArrayData const * value1,
+		ArrayData const * value2);
 typedef bool (*ArrayFilter)(ArrayData * value, UserData * data);
 typedef bool (*ArrayFilterSwap)(UserData * data, ArrayData * value);
 typedef void (*ArrayForeach)(ArrayData * value, UserData * data);
 typedef void (*ArrayForeachSwap)(UserData * data, ArrayData * value);
+typedef void (*ArrayMap)(ArrayData const * value, ArrayData * result,
+		UserData * data);
 
 
 /* functions */
 Array * array_new(size_t size);
+/* copies share their storage until modified: write through the pointers
+ * obtained with the *_mutable() accessors only */
 Array * array_new_copy(Array const * from);
 Array * array_new_filter(Array const * from, ArrayFilter func, UserData * data);
 Array * array_new_filter_swap(Array const * from, ArrayFilterSwap func,
@@ -83,21 +167,57 @@ void array_delete(Array * array);
 /* accessors */
 size_t array_count(Array const * array);
 
+/* writing through this pointer also affects the copies sharing the storage */
 void * array_get(Array const * array, size_t pos);
+size_t array_get_capacity(Array const * array);
+void const * array_get_const(Array const * array, size_t pos);
 ArrayError array_get_copy(Array const * array, size_t pos, ArrayData * value);
+/* contiguous elements, invalidated by any modification */
+void const * array_get_data(Array const * array, size_t * count);
+/* the storage is no longer shared once these return */
+void * array_get_data_mutable(Array * array, size_t * count);
+void * array_get_mutable(Array * array, size_t pos);
 size_t array_get_size(Array const * array);
+void array_get_view(Array const * array, ArrayView * view);
 ArrayError array_set(Array * array, size_t pos, ArrayData * value);
 
 /* useful */
 ArrayError array_append(Array * array, ArrayData * value);
+ArrayError array_append_n(Array * array, ArrayData * values, size_t count);
+void const * array_bsearch(Array const * array, ArrayData const * key,
+		ArrayCompare compare);
 ArrayError array_copy(Array * array, Array const * from);
 ArrayError array_insert(Array * array, size_t pos, ArrayData * value);
+ArrayError array_insert_n(Array * array, size_t pos, ArrayData * values,
+		size_t count);
+ArrayError array_insert_sorted(Array * array, ArrayData * value,
+		ArrayCompare compare);
+size_t array_lower_bound(Array const * array, ArrayData const * key,
+		ArrayCompare compare);
+/* resizes array to the count of from, storing the results */
+ArrayError array_map(Array * array, Array const * from, ArrayMap func,
+		UserData * data);
+/* splits the work as array_foreach_parallel() does */
+ArrayError array_map_parallel(Array * array, Array const * from,
+		ArrayMap func, UserData * data, unsigned int nthreads);
+/* keeps the elements accepted, returns the others */
+Array * array_partition(Array * array, ArrayFilter func, UserData * data);
 ArrayError array_prepend(Array * array, ArrayData * value);
 ArrayError array_remove_pos(Array * array, size_t pos);
+ArrayError array_remove_range(Array * array, size_t pos, size_t count);
+ArrayError array_reserve(Array * array, size_t count);
+ArrayError array_resize(Array * array, size_t count);
+ArrayError array_shrink_to_fit(Array * array);
+void array_sort(Array * array, ArrayCompare compare);
+ArrayError array_sort_stable(Array * array, ArrayCompare compare);
 
 void array_filter(Array * array, ArrayFilter func, UserData * data);
 void array_filter_swap(Array * array, ArrayFilter func, UserData * data);
 void array_foreach(Array const * array, ArrayForeachSwap func, UserData * data);
+/* uses one thread per processor when nthreads is 0, each handling at least
+ * 1024 elements: smaller arrays are handled by the calling thread alone */
+void array_foreach_parallel(Array const * array, ArrayForeach func,
+		UserData * data, unsigned int nthreads);
 void array_foreach_swap(Array const * array, ArrayForeachSwap func,
 		UserData * data);
 
@@ -31,6 +31,7 @@
 #ifndef LIBSYSTEM_SYSTEM_CONFIG_H
 # define LIBSYSTEM_SYSTEM_CONFIG_H
 
+# include "hash.h"
 # include "string.h"
 
 # ifdef __cplusplus
@@ -51,6 +52,11 @@ typedef void (*ConfigForeachSectionCallback)(Config const * config,
 
 /* functions */
 Config * config_new(void);
+/* lookups may happen in parallel to a single writer, but config_reset()
+ * requires exclusive access: the values replaced meanwhile remain valid until
+ * then. Every config_set() copies the section modified, so that loading a
+ * section of n variables costs O(n^2) */
+Config * config_new_concurrent(void);
 Config * config_new_copy(Config const * from);
 Config * config_new_load(String const * filename);
 void config_delete(Config * config);
@@ -58,6 +64,8 @@ void config_delete(Config * config);
 /* accessors */
 String const * config_get(Config const * config, String const * section,
 		String const * variable);
+/* aggregated over every section, the interned variable names excepted */
+void config_get_stats(Config const * config, HashStats * stats);
 int config_set(Config * config, String const * section, String const * variable,
 		String const * value);
 
@@ -0,0 +1,104 @@
+/* $Id$ */
+/* Copyright (c) 2026 Pierre Pronchery <khorben@defora.org> */
+/* This file is part of DeforaOS System libSystem */
+/* All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+
+#ifndef LIBSYSTEM_SYSTEM_DEQUE_H
+# define LIBSYSTEM_SYSTEM_DEQUE_H
+
+# include <stddef.h>
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+
+/* Deque */
+/* macros */
+# define DEQUE(type) \
+	typedef struct _Deque type ## Deque; \
+	DEQUE_ACCESSORS(type, type)
+# define DEQUE2(type, name) \
+	typedef struct _Deque name ## Deque; \
+	DEQUE_ACCESSORS(type, name)
+/* typed accessors, copying the elements by value */
+# define DEQUE_ACCESSORS(type, name) \
+	static inline Deque * name ## deque_new(void) \
+		{ return deque_new(sizeof(type)); } \
+	static inline type * name ## deque_get(Deque const * deque, \
+			size_t pos) \
+		{ return (type *)deque_get(deque, pos); } \
+	static inline DequeError name ## deque_pop_back(Deque * deque, \
+			type * value) \
+		{ return deque_pop_back(deque, value); } \
+	static inline DequeError name ## deque_pop_front(Deque * deque, \
+			type * value) \
+		{ return deque_pop_front(deque, value); } \
+	static inline DequeError name ## deque_push_back(Deque * deque, \
+			type value) \
+		{ return deque_push_back(deque, &value); } \
+	static inline DequeError name ## deque_push_front(Deque * deque, \
+			type value) \
+		{ return deque_push_front(deque, &value); }
+
+
+/* types */
+typedef struct _Deque Deque;
+typedef void DequeData;
+typedef int DequeError;
+
+
+/* functions */
+Deque * deque_new(size_t size);
+void deque_delete(Deque * deque);
+
+/* accessors */
+size_t deque_count(Deque const * deque);
+
+/* positions are relative to the front */
+void * deque_get(Deque const * deque, size_t pos);
+void * deque_get_back(Deque const * deque);
+size_t deque_get_capacity(Deque const * deque);
+DequeError deque_get_copy(Deque const * deque, size_t pos, DequeData * value);
+void * deque_get_front(Deque const * deque);
+size_t deque_get_size(Deque const * deque);
+
+/* useful */
+void deque_clear(Deque * deque);
+/* the value removed is copied unless NULL */
+DequeError deque_pop_back(Deque * deque, DequeData * value);
+DequeError deque_pop_front(Deque * deque, DequeData * value);
+DequeError deque_push_back(Deque * deque, DequeData * value);
+DequeError deque_push_front(Deque * deque, DequeData * value);
+DequeError deque_reserve(Deque * deque, size_t count);
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* !LIBSYSTEM_SYSTEM_DEQUE_H */
@@ -42,6 +42,9 @@ extern "C" {
 /* Event */
 /* types */
 typedef struct _Event Event;
+/* returned by the event_add_*() functions, valid until cancelled, until its
+ * callback returns non-zero, or until unregistered by event_unregister_*() */
+typedef struct _EventHandle EventHandle;
 
 typedef int (*EventIOFunc)(int fd, void * data);
 typedef int (*EventTimeoutFunc)(void * data);
@@ -49,9 +52,29 @@ typedef int (*EventTimeoutFunc)(void * data);
 
 /* functions */
 Event * event_new(void);
+/* backend is "epoll" or "select", or NULL for the best available */
+Event * event_new_backend(char const * backend);
 void event_delete(Event * event);
 
+/* accessors */
+char const * event_get_backend(Event const * event);
+/* replaces the callback of a file descriptor watcher */
+int event_set_io(Event * event, EventHandle * handle, EventIOFunc func,
+		void * userdata);
+/* re-arms a timeout, or applies once it is dispatched */
+int event_set_timeout(Event * event, EventHandle * handle,
+		struct timeval * timeout);
+
 /* useful */
+EventHandle * event_add_idle(Event * event, EventTimeoutFunc func,
+		void * userdata);
+EventHandle * event_add_io_read(Event * event, int fd, EventIOFunc func,
+		void * userdata);
+EventHandle * event_add_io_write(Event * event, int fd, EventIOFunc func,
+		void * userdata);
+EventHandle * event_add_timeout(Event * event, struct timeval * timeout,
+		EventTimeoutFunc func, void * userdata);
+int event_cancel(Event * event, EventHandle * handle);
 int event_loop(Event * event);
 void event_loop_quit(Event * event);
 int event_loop_while(Event * event, const int * flag);
@@ -60,6 +83,9 @@ int event_register_io_read(Event * event, int fd, EventIOFunc func,
 		void * userdata);
 int event_register_io_write(Event * event, int fd, EventIOFunc func,
 		void * userdata);
+/* timeouts are relative to the current time, on a monotonic clock: from the
+ * callbacks, relative to the start of the current iteration instead, and may
+ * therefore fire early by the time spent in the callbacks meanwhile */
 int event_register_timeout(Event * event, struct timeval * timeout,
 		EventTimeoutFunc func, void * userdata);
 int event_unregister_io_read(Event * event, int fd);
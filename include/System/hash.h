@@ -31,7 +31,9 @@
 #ifndef LIBSYSTEM_SYSTEM_HASH_H
 # define LIBSYSTEM_SYSTEM_HASH_H
 
+# include <stdbool.h>
 # include <stddef.h>
+# include <stdint.h>
 
 # ifdef __cplusplus
 extern "C" {
@@ -43,29 +45,110 @@ extern "C" {
 typedef struct _Hash Hash;
 
 typedef unsigned int (*HashFunc)(void const * value);
+typedef uint64_t (*HashFuncSeed)(void const * value, uint64_t seed);
 typedef int (*HashCompare)(void const * value1, void const * value2);
 typedef void (*HashForeach)(Hash const * hash, void const * key, void * value,
 		void * data);
+typedef void (*HashRelease)(void const * data);
+/* returns the reference to keep, or NULL in case of error */
+typedef void * (*HashRetain)(void const * data);
+
+/* a key along with its hash value, as returned by hash_get_hash() */
+typedef struct _HashKey
+{
+	void const * key;
+	unsigned int hash;
+} HashKey;
+# define HASH_KEY_INIT(key, hash) { (key), (hash) }
+
+/* memory usage and lookup performance */
+typedef struct _HashStats
+{
+	size_t count;
+	/* buckets in the index, or entries stored inline if there is none */
+	size_t capacity;
+	/* bytes allocated for the table */
+	size_t size;
+	double load;
+	/* buckets or entries examined to find an existing key */
+	double probe_avg;
+	size_t probe_max;
+	/* entries sharing their hash value with an earlier entry */
+	size_t collisions;
+} HashStats;
+
+/* iterates in insertion order, see hash_iter_begin() */
+typedef struct _HashIterator
+{
+	Hash const * hash;
+	size_t pos;
+} HashIterator;
 
 
 /* functions */
 Hash * hash_new(HashFunc func, HashCompare compare);
+Hash * hash_new_capacity(HashFunc func, HashCompare compare, size_t capacity);
+/* lookups never block, while modifications are serialized and copy the table:
+ * each costs O(n) in the count of entries, and filling the table O(n^2), so
+ * that it suits data read far more often than it is modified. The values
+ * remain valid until replaced, and the table must not be modified while
+ * iterating */
+Hash * hash_new_concurrent(HashFunc func, HashCompare compare);
+Hash * hash_new_seed(HashFuncSeed func, uint64_t seed, HashCompare compare);
+/* the copy shares the table until either hash is modified */
 Hash * hash_new_copy(Hash const * from);
 void hash_delete(Hash * h);
 
 /* helpers */
 extern unsigned int hash_func_string(void const * value);
+extern uint64_t hash_func_string64(void const * value, uint64_t seed);
 extern int hash_compare_string(void const * value1, void const * value2);
 
 /* accessors */
 void * hash_get(Hash const * h, void const * key);
+void * hash_get_prehashed(Hash const * hash, void const * key, unsigned int h);
+HashCompare hash_get_compare(Hash const * hash);
+unsigned int hash_get_hash(Hash const * hash, void const * key);
+void hash_get_stats(Hash const * hash, HashStats * stats);
 void const * hash_get_key(Hash const * h, void const * key);
+/* does not set any error when the key is not found */
+void const * hash_get_key_prehashed(Hash const * hash, void const * key,
+		unsigned int h);
 int hash_set(Hash * h, void const * key, void * value);
+int hash_set_prehashed(Hash * hash, void const * key, unsigned int h,
+		void * value);
+/* previous is set to the key stored beforehand if any, which is kept when only
+ * replacing the value */
+int hash_set_key_prehashed(Hash * hash, void const * key, unsigned int h,
+		void * value, void const ** previous);
 size_t hash_count(Hash const * hash);
+/* the keys or values are retained whenever the table is duplicated, and
+ * released along with the last copy or when reset, but not when set */
+void hash_set_key_ownership(Hash * hash, HashRetain retain,
+		HashRelease release);
+void hash_set_value_ownership(Hash * hash, HashRetain retain,
+		HashRelease release);
+
+bool hash_is_concurrent(Hash const * hash);
+
+void hash_key_init(HashKey * hk, Hash const * hash, void const * key);
 
 /* useful */
 void hash_foreach(Hash const * hash, HashForeach func, void * data);
+
+void hash_iter_begin(Hash const * hash, HashIterator * iterator);
+void const * hash_iter_key(HashIterator const * iterator);
+bool hash_iter_next(HashIterator * iterator);
+void * hash_iter_value(HashIterator const * iterator);
+
+int hash_reserve(Hash * hash, size_t count);
 int hash_reset(Hash * hash);
+/* releases a former key or value once no reader can access it anymore, that
+ * is right away unless concurrent, or else when the hash is reset or deleted:
+ * the data retired accumulates until then */
+int hash_retire(Hash * hash, void const * data, HashRelease release);
+/* stops sharing the table with the copies, if any */
+int hash_unshare(Hash * hash);
 
 # ifdef __cplusplus
 }
@@ -31,6 +31,7 @@
 #ifndef LIBSYSTEM_SYSTEM_MUTATOR_H
 # define LIBSYSTEM_SYSTEM_MUTATOR_H
 
+# include "hash.h"
 # include "string.h"
 
 # ifdef __cplusplus
@@ -48,16 +49,27 @@ typedef void (*MutatorForeach)(Mutator const * mutator,
 
 /* functions */
 Mutator * mutator_new(void);
+Mutator * mutator_new_concurrent(void);
 Mutator * mutator_new_copy(Mutator const * from);
+/* the keys are shared with string_intern(), and compared by address: the
+ * hash_*() functions only find them when given interned keys */
+Mutator * mutator_new_interned(void);
 void mutator_delete(Mutator * mutator);
 
 /* accessors */
 void * mutator_get(Mutator const * mutator, String const * key);
+void * mutator_get_prehashed(Mutator const * mutator, String const * key,
+		unsigned int h);
+/* accounts for the keys unless interned */
+void mutator_get_stats(Mutator const * mutator, HashStats * stats);
 int mutator_set(Mutator * mutator, String const * key, void * value);
+int mutator_set_prehashed(Mutator * mutator, String const * key,
+		unsigned int h, void * value);
 size_t mutator_count(Mutator const * mutator);
 
 /* useful */
 void mutator_foreach(Mutator const * mutator, MutatorForeach func, void * data);
+int mutator_reserve(Mutator * mutator, size_t count);
 int mutator_reset(Mutator * mutator);
 
 # ifdef __cplusplus
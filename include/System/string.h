@@ -84,6 +84,13 @@ String * string_find(String const * string, String const * key);
 ssize_t string_index(String const * string, String const * key);
 ssize_t string_rindex(String const * string, String const * key);
 
+/* returns a shared copy of the string, unique for a given value */
+String const * string_intern(String const * string);
+/* returns the shared copy if any, without retaining it: only valid for as long
+ * as another reference is held */
+String const * string_intern_find(String const * string);
+void string_intern_release(String const * string);
+
 int string_replace(String ** string, String const * what, String const * by);
 
 size_t string_ltrim(String * string, String const * which);
@@ -28,25 +28,71 @@
 
 
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
 #include <errno.h>
 #include "System/error.h"
 #include "System/object.h"
 #include "System/array.h"
 
+/* constants */
+#define ARRAY_CAPACITY_MIN	4
+/* below this count, insertion sort is faster */
+#define ARRAY_SORT_INSERTION	16
+/* minimum count of elements handled by each thread */
+#define ARRAY_PARALLEL_MIN	1024
+
 
 /* Array */
-/* protected */
+/* private */
 /* types */
-struct _Array
+typedef struct _ArrayParallel
 {
-	uint32_t count;
-	uint32_t size;
-	char * value;
-};
+	Array const * array;
+	Array * to;
+	ArrayForeach foreach;
+	ArrayMap map;
+	UserData * data;
+	size_t first;
+	size_t count;
+	pthread_t thread;
+	bool started;
+} ArrayParallel;
+
+
+/* variables */
+/* the count of processors, queried once */
+static unsigned int _array_parallel_cpus = 1;
+
+
+/* prototypes */
+static ArrayError _array_grow(Array * array, size_t count);
+static ArrayError _array_resize(Array * array, size_t capacity);
+static ArrayHeader * _array_header(Array const * array);
+static void _array_release(Array * array);
+static ArrayError _array_unshare(Array * array);
+
+static void _array_parallel(ArrayParallel * ap, unsigned int nthreads);
+static void _array_parallel_init(void);
+static void _array_parallel_run(ArrayParallel * ap);
+static void * _array_parallel_thread(void * arg);
+
+static size_t _array_upper_bound(Array const * array, ArrayData const * key,
+		ArrayCompare compare);
+
+static void _array_swap(char * value1, char * value2, size_t size);
+static void _array_sort_heap(char * base, size_t count, size_t size,
+		ArrayCompare compare);
+static void _array_sort_insertion(char * base, size_t count, size_t size,
+		ArrayCompare compare);
+static void _array_sort_intro(char * base, size_t count, size_t size,
+		ArrayCompare compare, unsigned int depth);
+static void _array_sort_merge(char * base, char * tmp, size_t count,
+		size_t size, ArrayCompare compare);
 
 
 /* public */
@@ -55,7 +101,7 @@ Array * array_new(size_t size)
 {
 	Array * array;
 
-	/* check for overflows */
+	/* check for overflows: the elements themselves remain 32-bit */
 	if(UINT32_MAX < SIZE_MAX && size > UINT32_MAX)
 	{
 		error_set_code(-ERANGE, "%s", strerror(ERANGE));
@@ -64,6 +110,7 @@ Array * array_new(size_t size)
 	if((array = (Array *)object_new(sizeof(*array))) == NULL)
 		return NULL;
 	array->count = 0;
+	array->capacity = 0;
 	array->size = size;
 	array->value = NULL;
 	return array;
@@ -77,12 +124,11 @@ Array * array_new_copy(Array const * from)
 
 	if((array = (Array *)object_new(sizeof(*array))) == NULL)
 		return NULL;
+	array->count = 0;
+	array->capacity = 0;
+	array->size = from->size;
 	array->value = NULL;
-	if(array_copy(array, from) != 0)
-	{
-		array_delete(array);
-		return NULL;
-	}
+	array_copy(array, from);
 	return array;
 }
 
@@ -137,7 +183,7 @@ Array * array_new_filter_swap(Array const * from, ArrayFilterSwap func,
 /* array_delete */
 void array_delete(Array * array)
 {
-	free(array->value);
+	_array_release(array);
 	object_delete(array);
 }
 
@@ -153,7 +199,41 @@ size_t array_count(Array const * array)
 /* array_get */
 void * array_get(Array const * array, size_t pos)
 {
-	uint64_t offset;
+	return (void *)array_get_const(array, pos);
+}
+
+
+/* array_get_capacity */
+size_t array_get_capacity(Array const * array)
+{
+	return array->capacity;
+}
+
+
+/* array_get_data */
+void const * array_get_data(Array const * array, size_t * count)
+{
+	if(count != NULL)
+		*count = array->count;
+	return (array->count > 0) ? array->value : NULL;
+}
+
+
+/* array_get_data_mutable */
+void * array_get_data_mutable(Array * array, size_t * count)
+{
+	if(count != NULL)
+		*count = array->count;
+	if(array->count == 0 || _array_unshare(array) != 0)
+		return NULL;
+	return array->value;
+}
+
+
+/* array_get_const */
+void const * array_get_const(Array const * array, size_t pos)
+{
+	size_t offset;
 
 	if(pos >= array->count)
 		return NULL;
@@ -165,7 +245,7 @@ void * array_get(Array const * array, size_t pos)
 /* array_get_copy */
 ArrayError array_get_copy(Array const * array, size_t pos, ArrayData * value)
 {
-	uint64_t offset;
+	size_t offset;
 
 	if(pos >= array->count)
 		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
@@ -175,6 +255,15 @@ ArrayError array_get_copy(Array const * array, size_t pos, ArrayData * value)
 }
 
 
+/* array_get_mutable */
+void * array_get_mutable(Array * array, size_t pos)
+{
+	if(pos >= array->count || _array_unshare(array) != 0)
+		return NULL;
+	return &array->value[pos * array->size];
+}
+
+
 /* array_get_size */
 size_t array_get_size(Array const * array)
 {
@@ -182,27 +271,37 @@ size_t array_get_size(Array const * array)
 }
 
 
+/* array_get_view */
+void array_get_view(Array const * array, ArrayView * view)
+{
+	view->data = (array->count > 0) ? array->value : NULL;
+	view->count = array->count;
+	view->size = array->size;
+}
+
+
 /* array_set */
 ArrayError array_set(Array * array, size_t pos, ArrayData * value)
 {
-	uint32_t p = pos + 1;
-	uint64_t offset;
-	uint64_t curpos;
-	void * q;
+	size_t p = pos + 1;
+	size_t offset;
+	size_t curpos;
 
 	/* check for overflows */
-	if(pos >= UINT32_MAX)
+	if(pos >= SIZE_MAX || (array->size != 0
+				&& pos > SIZE_MAX / array->size))
 		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
 	offset = pos * array->size;
-	if(array->count < p)
+	if(array->count >= p)
+	{
+		if(_array_unshare(array) != 0)
+			return -1;
+	}
+	else
 	{
 		/* grow the array */
-		if(UINT64_MAX - offset < array->size
-				|| offset + array->size > SIZE_MAX)
-			return error_set_code(-ERANGE, "%s", strerror(ERANGE));
-		if((q = realloc(array->value, offset + array->size)) == NULL)
-			return error_set_code(-errno, "%s", strerror(errno));
-		array->value = (char *)q;
+		if(_array_grow(array, p) != 0)
+			return -1;
 		curpos = array->count * array->size;
 		memset(&array->value[curpos], 0, offset - curpos);
 		array->count = pos + 1;
@@ -217,34 +316,55 @@ ArrayError array_set(Array * array, size_t pos, ArrayData * value)
 /* array_append */
 ArrayError array_append(Array * array, ArrayData * value)
 {
-	char * p;
-	uint64_t offset = array->size * array->count;
+	size_t offset = array->size * array->count;
 
 	/* check for overflows */
-	if(UINT64_MAX - offset < array->size
-			|| offset + array->size > SIZE_MAX)
+	if(array->count == SIZE_MAX)
 		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
-	if((p = (char *)realloc(array->value, offset + array->size)) == NULL)
-		return error_set_code(-errno, "%s", strerror(errno));
-	array->value = p;
-	memcpy(&p[offset], value, array->size);
+	if(_array_grow(array, array->count + 1) != 0)
+		return -1;
+	memcpy(&array->value[offset], value, array->size);
 	array->count++;
 	return 0;
 }
 
 
+/* array_append_n */
+ArrayError array_append_n(Array * array, ArrayData * values, size_t count)
+{
+	return array_insert_n(array, array->count, values, count);
+}
+
+
+/* array_bsearch */
+void const * array_bsearch(Array const * array, ArrayData const * key,
+		ArrayCompare compare)
+{
+	size_t pos;
+	char const * p;
+
+	pos = array_lower_bound(array, key, compare);
+	if(pos == array->count)
+		return NULL;
+	p = &array->value[pos * array->size];
+	return (compare(p, key) == 0) ? p : NULL;
+}
+
+
 /* array_copy */
 ArrayError array_copy(Array * array, Array const * from)
 {
-	char * p;
-
-	if((p = (char *)realloc(array->value, from->count * from->size)) == NULL
-			&& from->count != 0 && from->size != 0)
-		return error_set_code(-errno, "%s", strerror(errno));
+	if(array == from)
+		return 0;
+	/* share the storage until either array is modified */
+	if(from->value != NULL)
+		__atomic_fetch_add(&_array_header(from)->refcount, 1,
+				__ATOMIC_SEQ_CST);
+	_array_release(array);
 	array->count = from->count;
+	array->capacity = from->capacity;
 	array->size = from->size;
-	array->value = p;
-	memcpy(array->value, from->value, array->count * array->size);
+	array->value = from->value;
 	return 0;
 }
 
@@ -253,19 +373,14 @@ ArrayError array_copy(Array * array, Array const * from)
 ArrayError array_insert(Array * array, size_t pos, ArrayData * value)
 {
 	char * p;
-	uint64_t offset = array->size * pos;
-	uint64_t size = array->size * (array->count + 1);
+	size_t offset = array->size * pos;
 
 	/* check for errors */
-	if(pos > array->count)
-		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
-	/* check for overflows */
-	if(UINT64_MAX - offset < array->size
-			|| offset + array->size > SIZE_MAX)
+	if(pos > array->count || array->count == SIZE_MAX)
 		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
-	if((p = (char *)realloc(array->value, size)) == NULL)
-		return error_set_code(-errno, "%s", strerror(errno));
-	array->value = p;
+	if(_array_grow(array, array->count + 1) != 0)
+		return -1;
+	p = array->value;
 	memmove(&p[offset + array->size], &p[offset], array->size
 			* (array->count - pos));
 	memcpy(&p[offset], value, array->size);
@@ -274,6 +389,126 @@ ArrayError array_insert(Array * array, size_t pos, ArrayData * value)
 }
 
 
+/* array_insert_n */
+ArrayError array_insert_n(Array * array, size_t pos, ArrayData * values,
+		size_t count)
+{
+	size_t offset = array->size * pos;
+
+	/* check for errors */
+	if(pos > array->count)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if(count == 0)
+		return 0;
+	/* check for overflows */
+	if(count > SIZE_MAX - array->count)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if(_array_grow(array, array->count + count) != 0)
+		return -1;
+	memmove(&array->value[offset + array->size * count],
+			&array->value[offset],
+			array->size * (array->count - pos));
+	memcpy(&array->value[offset], values, array->size * count);
+	array->count += count;
+	return 0;
+}
+
+
+/* array_insert_sorted */
+ArrayError array_insert_sorted(Array * array, ArrayData * value,
+		ArrayCompare compare)
+{
+	/* after the equal elements, to keep the order of insertion */
+	return array_insert(array, _array_upper_bound(array, value, compare),
+			value);
+}
+
+
+/* array_lower_bound */
+size_t array_lower_bound(Array const * array, ArrayData const * key,
+		ArrayCompare compare)
+{
+	size_t lo = 0;
+	size_t hi = array->count;
+	size_t mid;
+
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if(compare(&array->value[mid * array->size], key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+/* array_map */
+ArrayError array_map(Array * array, Array const * from, ArrayMap func,
+		UserData * data)
+{
+	return array_map_parallel(array, from, func, data, 1);
+}
+
+
+/* array_map_parallel */
+ArrayError array_map_parallel(Array * array, Array const * from,
+		ArrayMap func, UserData * data, unsigned int nthreads)
+{
+	ArrayParallel ap;
+
+	if(array == from)
+		return error_set_code(-EINVAL, "%s", strerror(EINVAL));
+	if(array_resize(array, from->count) != 0 || _array_unshare(array) != 0)
+		return -1;
+	ap.array = from;
+	ap.to = array;
+	ap.foreach = NULL;
+	ap.map = func;
+	ap.data = data;
+	_array_parallel(&ap, nthreads);
+	return 0;
+}
+
+
+/* array_partition */
+Array * array_partition(Array * array, ArrayFilter func, UserData * data)
+{
+	Array * ret;
+	size_t i;
+	size_t j;
+	size_t offset;
+
+	if((ret = array_new(array->size)) == NULL)
+		return NULL;
+	/* make sure not to fail once the array is modified */
+	if(array_reserve(ret, array->count) != 0
+			|| _array_unshare(array) != 0)
+	{
+		array_delete(ret);
+		return NULL;
+	}
+	for(i = 0, j = 0, offset = 0; i < array->count;
+			i++, offset += array->size)
+		if(func(array->value + offset, data) == true)
+		{
+			if(i != j)
+				memcpy(&array->value[j * array->size],
+						&array->value[offset],
+						array->size);
+			j++;
+		}
+		else
+			memcpy(&ret->value[ret->count++ * ret->size],
+					&array->value[offset], array->size);
+	array->count = j;
+	/* the array remains valid even if this fails */
+	array_shrink_to_fit(ret);
+	return ret;
+}
+
+
 /* array_prepend */
 ArrayError array_prepend(Array * array, ArrayData * value)
 {
@@ -284,19 +519,102 @@ ArrayError array_prepend(Array * array, ArrayData * value)
 /* array_remove_pos */
 ArrayError array_remove_pos(Array * array, size_t pos)
 {
-	void * p;
-
 	if(pos >= array->count)
 		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if(pos + 1 < array->count && _array_unshare(array) != 0)
+		return -1;
 	array->count--;
+	/* keep the capacity, see array_shrink_to_fit() */
 	memmove(&array->value[pos * array->size],
 			&array->value[(pos + 1) * array->size],
 			(array->count - pos) * array->size);
-	if((p = realloc(array->value, array->size * array->count)) == NULL
-			&& array->count != 0)
-		/* XXX ignore the error */
+	return 0;
+}
+
+
+/* array_remove_range */
+ArrayError array_remove_range(Array * array, size_t pos, size_t count)
+{
+	if(pos > array->count || count > array->count - pos)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if(pos + count < array->count && _array_unshare(array) != 0)
+		return -1;
+	array->count -= count;
+	memmove(&array->value[pos * array->size],
+			&array->value[(pos + count) * array->size],
+			(array->count - pos) * array->size);
+	return 0;
+}
+
+
+/* array_reserve */
+ArrayError array_reserve(Array * array, size_t count)
+{
+	if(count <= array->capacity)
 		return 0;
-	array->value = (char *)p;
+	return _array_resize(array, count);
+}
+
+
+/* array_resize */
+ArrayError array_resize(Array * array, size_t count)
+{
+	if(count > array->count)
+	{
+		/* the new elements are zeroed */
+		if(_array_grow(array, count) != 0)
+			return -1;
+		memset(&array->value[array->size * array->count], 0,
+				array->size * (count - array->count));
+	}
+	array->count = count;
+	return 0;
+}
+
+
+/* array_shrink_to_fit */
+ArrayError array_shrink_to_fit(Array * array)
+{
+	if(array->capacity == array->count)
+		return 0;
+	return _array_resize(array, array->count);
+}
+
+
+/* array_sort */
+void array_sort(Array * array, ArrayCompare compare)
+{
+	unsigned int depth;
+	size_t i;
+
+	if(_array_unshare(array) != 0)
+		return;
+	/* fallback to heapsort beyond 2 * log2(count) levels of recursion */
+	for(depth = 0, i = array->count; i > 1; i >>= 1)
+		depth += 2;
+	_array_sort_intro(array->value, array->count, array->size, compare,
+			depth);
+}
+
+
+/* array_sort_stable */
+ArrayError array_sort_stable(Array * array, ArrayCompare compare)
+{
+	char * tmp;
+
+	if(_array_unshare(array) != 0)
+		return -1;
+	if(array->count <= ARRAY_SORT_INSERTION)
+	{
+		_array_sort_insertion(array->value, array->count, array->size,
+				compare);
+		return 0;
+	}
+	if((tmp = (char *)malloc(array->count * array->size)) == NULL)
+		return error_set_code(-errno, "%s", strerror(errno));
+	_array_sort_merge(array->value, tmp, array->count, array->size,
+			compare);
+	free(tmp);
 	return 0;
 }
 
@@ -304,57 +622,437 @@ ArrayError array_remove_pos(Array * array, size_t pos)
 /* array_filter */
 void array_filter(Array * array, ArrayFilter func, UserData * data)
 {
-	uint32_t i;
-	uint64_t offset;
+	size_t i;
+	size_t j;
+	size_t offset;
 
-	for(i = 0, offset = 0; i < array->count;)
-		if(func(array->value + offset, data) == false)
-			/* cannot fail */
-			array_remove_pos(array, i);
-		else
+	if(_array_unshare(array) != 0)
+		return;
+	/* move the elements kept over the ones removed, in a single pass */
+	for(i = 0, j = 0, offset = 0; i < array->count;
+			i++, offset += array->size)
+		if(func(array->value + offset, data) == true)
 		{
-			i++;
-			offset += array->size;
+			if(i != j)
+				memcpy(&array->value[j * array->size],
+						&array->value[offset],
+						array->size);
+			j++;
 		}
+	array->count = j;
 }
 
 
 /* array_filter_swap */
 void array_filter_swap(Array * array, ArrayFilterSwap func, UserData * data)
 {
-	uint32_t i;
-	uint64_t offset;
+	size_t i;
+	size_t j;
+	size_t offset;
 
-	for(i = 0, offset = 0; i < array->count;)
-		if(func(data, array->value + offset) == false)
-			/* cannot fail */
-			array_remove_pos(array, i);
-		else
+	if(_array_unshare(array) != 0)
+		return;
+	for(i = 0, j = 0, offset = 0; i < array->count;
+			i++, offset += array->size)
+		if(func(data, array->value + offset) == true)
 		{
-			i++;
-			offset += array->size;
+			if(i != j)
+				memcpy(&array->value[j * array->size],
+						&array->value[offset],
+						array->size);
+			j++;
 		}
+	array->count = j;
 }
 
 
 /* array_foreach */
 void array_foreach(Array const * array, ArrayForeach func, UserData * data)
 {
-	uint32_t i;
-	uint64_t offset;
+	size_t i;
+	size_t offset;
 
 	for(i = 0, offset = 0; i < array->count; i++, offset += array->size)
 		func(array->value + offset, data);
 }
 
 
+/* array_foreach_parallel */
+void array_foreach_parallel(Array const * array, ArrayForeach func,
+		UserData * data, unsigned int nthreads)
+{
+	ArrayParallel ap;
+
+	ap.array = array;
+	ap.to = NULL;
+	ap.foreach = func;
+	ap.map = NULL;
+	ap.data = data;
+	_array_parallel(&ap, nthreads);
+}
+
+
 /* array_foreach_swap */
 void array_foreach_swap(Array const * array, ArrayForeachSwap func,
 		UserData * data)
 {
-	uint32_t i;
-	uint64_t offset;
+	size_t i;
+	size_t offset;
 
 	for(i = 0, offset = 0; i < array->count; i++, offset += array->size)
 		func(data, array->value + offset);
 }
+
+
+/* private */
+/* functions */
+/* array_grow */
+static ArrayError _array_grow(Array * array, size_t count)
+{
+	size_t capacity;
+
+	if(count <= array->capacity)
+		return _array_unshare(array);
+	/* grow geometrically to append in amortized constant time */
+	if(array->capacity < ARRAY_CAPACITY_MIN)
+		capacity = ARRAY_CAPACITY_MIN;
+	else if(array->capacity > SIZE_MAX / 2)
+		capacity = SIZE_MAX;
+	else
+		capacity = array->capacity * 2;
+	if(capacity < count)
+		capacity = count;
+	/* fallback to the exact count if the memory is tight */
+	if(_array_resize(array, capacity) != 0 && (capacity == count
+				|| _array_resize(array, count) != 0))
+		return -1;
+	return 0;
+}
+
+
+/* array_parallel */
+static void _array_parallel(ArrayParallel * ap, unsigned int nthreads)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	ArrayParallel * aps;
+	size_t count = ap->array->count;
+	size_t first;
+	unsigned int i;
+
+	/* fallback to the current thread for small arrays */
+	if(count < ARRAY_PARALLEL_MIN * 2)
+		nthreads = 1;
+	else if(nthreads == 0)
+	{
+		pthread_once(&once, _array_parallel_init);
+		nthreads = _array_parallel_cpus;
+	}
+	if(nthreads > count / ARRAY_PARALLEL_MIN)
+		nthreads = count / ARRAY_PARALLEL_MIN;
+	if(nthreads <= 1 || (aps = (ArrayParallel *)malloc(sizeof(*aps)
+					* nthreads)) == NULL)
+	{
+		ap->first = 0;
+		ap->count = count;
+		_array_parallel_run(ap);
+		return;
+	}
+	/* split the array into contiguous chunks */
+	for(i = 0, first = 0; i < nthreads; i++)
+	{
+		aps[i] = *ap;
+		aps[i].first = first;
+		aps[i].count = count / nthreads
+			+ ((i < count % nthreads) ? 1 : 0);
+		aps[i].started = false;
+		first += aps[i].count;
+	}
+	/* the current thread handles the first chunk */
+	for(i = 1; i < nthreads; i++)
+		aps[i].started = (pthread_create(&aps[i].thread, NULL,
+					_array_parallel_thread, &aps[i]) == 0);
+	_array_parallel_run(&aps[0]);
+	for(i = 1; i < nthreads; i++)
+		if(aps[i].started)
+			pthread_join(aps[i].thread, NULL);
+		else
+			_array_parallel_run(&aps[i]);
+	free(aps);
+}
+
+
+/* array_parallel_init */
+static void _array_parallel_init(void)
+{
+	long n;
+
+	_array_parallel_cpus = ((n = sysconf(_SC_NPROCESSORS_ONLN)) > 0)
+		? n : 1;
+}
+
+
+/* array_parallel_run */
+static void _array_parallel_run(ArrayParallel * ap)
+{
+	Array const * array = ap->array;
+	size_t i;
+	size_t offset = ap->first * array->size;
+	size_t offset2;
+
+	if(ap->foreach != NULL)
+		for(i = 0; i < ap->count; i++, offset += array->size)
+			ap->foreach(array->value + offset, ap->data);
+	else
+		for(i = 0, offset2 = ap->first * ap->to->size; i < ap->count;
+				i++, offset += array->size,
+				offset2 += ap->to->size)
+			ap->map(array->value + offset,
+					ap->to->value + offset2, ap->data);
+}
+
+
+/* array_parallel_thread */
+static void * _array_parallel_thread(void * arg)
+{
+	_array_parallel_run((ArrayParallel *)arg);
+	return NULL;
+}
+
+
+/* array_resize */
+static ArrayError _array_resize(Array * array, size_t capacity)
+{
+	ArrayHeader * header = _array_header(array);
+	ArrayHeader * p;
+	size_t size;
+
+	/* check for overflows */
+	if(array->size != 0 && capacity > (SIZE_MAX - sizeof(*p))
+			/ array->size)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if((size = capacity * array->size) == 0)
+		_array_release(array);
+	else if(header != NULL && __atomic_load_n(&header->refcount,
+				__ATOMIC_SEQ_CST) > 1)
+	{
+		/* leave the storage to the other copies */
+		if((p = (ArrayHeader *)malloc(sizeof(*p) + size)) == NULL)
+			return error_set_code(-errno, "%s", strerror(errno));
+		p->refcount = 1;
+		memcpy(p + 1, array->value, array->size
+				* ((array->count < capacity)
+					? array->count : capacity));
+		_array_release(array);
+		array->value = (char *)(p + 1);
+	}
+	else if((p = (ArrayHeader *)realloc(header, sizeof(*p) + size))
+			== NULL)
+		return error_set_code(-errno, "%s", strerror(errno));
+	else
+	{
+		if(header == NULL)
+			p->refcount = 1;
+		array->value = (char *)(p + 1);
+	}
+	array->capacity = capacity;
+	return 0;
+}
+
+
+/* array_header */
+static ArrayHeader * _array_header(Array const * array)
+{
+	if(array->value == NULL)
+		return NULL;
+	return (ArrayHeader *)array->value - 1;
+}
+
+
+/* array_release */
+static void _array_release(Array * array)
+{
+	ArrayHeader * header;
+
+	if((header = _array_header(array)) == NULL)
+		return;
+	/* the last copy frees the storage */
+	if(__atomic_fetch_sub(&header->refcount, 1, __ATOMIC_SEQ_CST) == 1)
+		free(header);
+	array->value = NULL;
+}
+
+
+/* array_unshare */
+static ArrayError _array_unshare(Array * array)
+{
+	if(ARRAY_IS_EXCLUSIVE(array))
+		return 0;
+	return _array_resize(array, array->capacity);
+}
+
+
+/* array_upper_bound */
+static size_t _array_upper_bound(Array const * array, ArrayData const * key,
+		ArrayCompare compare)
+{
+	size_t lo = 0;
+	size_t hi = array->count;
+	size_t mid;
+
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if(compare(&array->value[mid * array->size], key) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+/* array_swap */
+static void _array_swap(char * value1, char * value2, size_t size)
+{
+	char tmp[64];
+	size_t s;
+
+	for(; size > 0; size -= s, value1 += s, value2 += s)
+	{
+		s = (size < sizeof(tmp)) ? size : sizeof(tmp);
+		memcpy(tmp, value1, s);
+		memcpy(value1, value2, s);
+		memcpy(value2, tmp, s);
+	}
+}
+
+
+/* array_sort_heap */
+static void _array_sort_heap(char * base, size_t count, size_t size,
+		ArrayCompare compare)
+{
+	size_t i;
+	size_t j;
+	size_t k;
+
+	/* build the heap, then move its top to the end one at a time */
+	for(i = count / 2; count > 1;)
+	{
+		if(i > 0)
+			i--;
+		else
+			_array_swap(base, &base[--count * size], size);
+		/* sift down */
+		for(j = i; (k = 2 * j + 1) < count; j = k)
+		{
+			if(k + 1 < count && compare(&base[k * size],
+						&base[(k + 1) * size]) < 0)
+				k++;
+			if(compare(&base[j * size], &base[k * size]) >= 0)
+				break;
+			_array_swap(&base[j * size], &base[k * size], size);
+		}
+	}
+}
+
+
+/* array_sort_insertion */
+static void _array_sort_insertion(char * base, size_t count, size_t size,
+		ArrayCompare compare)
+{
+	size_t i;
+	size_t j;
+
+	/* stable, as equal elements are never swapped */
+	for(i = 1; i < count; i++)
+		for(j = i; j > 0 && compare(&base[(j - 1) * size],
+					&base[j * size]) > 0; j--)
+			_array_swap(&base[(j - 1) * size], &base[j * size],
+					size);
+}
+
+
+/* array_sort_intro */
+static void _array_sort_intro(char * base, size_t count, size_t size,
+		ArrayCompare compare, unsigned int depth)
+{
+	size_t mid;
+	size_t i;
+	size_t j;
+
+	while(count > ARRAY_SORT_INSERTION)
+	{
+		if(depth-- == 0)
+		{
+			_array_sort_heap(base, count, size, compare);
+			return;
+		}
+		/* use the median of three as the pivot, moved first */
+		mid = (count / 2) * size;
+		i = (count - 1) * size;
+		if(compare(&base[mid], base) < 0)
+			_array_swap(&base[mid], base, size);
+		if(compare(&base[i], &base[mid]) < 0)
+		{
+			_array_swap(&base[i], &base[mid], size);
+			if(compare(&base[mid], base) < 0)
+				_array_swap(&base[mid], base, size);
+		}
+		_array_swap(base, &base[mid], size);
+		/* partition around the pivot */
+		for(i = 0, j = count;;)
+		{
+			while(++i < count && compare(&base[i * size], base) < 0);
+			while(compare(&base[--j * size], base) > 0);
+			if(i >= j)
+				break;
+			_array_swap(&base[i * size], &base[j * size], size);
+		}
+		_array_swap(base, &base[j * size], size);
+		/* recurse into the smaller part only */
+		if(j < count - j - 1)
+		{
+			_array_sort_intro(base, j, size, compare, depth);
+			base = &base[(j + 1) * size];
+			count -= j + 1;
+		}
+		else
+		{
+			_array_sort_intro(&base[(j + 1) * size], count - j - 1,
+					size, compare, depth);
+			count = j;
+		}
+	}
+	_array_sort_insertion(base, count, size, compare);
+}
+
+
+/* array_sort_merge */
+static void _array_sort_merge(char * base, char * tmp, size_t count,
+		size_t size, ArrayCompare compare)
+{
+	size_t half = count / 2;
+	size_t i;
+	size_t j;
+	size_t k;
+
+	if(count <= ARRAY_SORT_INSERTION)
+	{
+		_array_sort_insertion(base, count, size, compare);
+		return;
+	}
+	_array_sort_merge(base, tmp, half, size, compare);
+	_array_sort_merge(&base[half * size], tmp, count - half, size, compare);
+	/* the halves may already be in order */
+	if(compare(&base[(half - 1) * size], &base[half * size]) <= 0)
+		return;
+	/* take from the left half first on equality, to remain stable */
+	for(i = 0, j = half, k = 0; i < half && j < count; k++)
+		if(compare(&base[j * size], &base[i * size]) < 0)
+			memcpy(&tmp[k * size], &base[j++ * size], size);
+		else
+			memcpy(&tmp[k * size], &base[i++ * size], size);
+	/* the rest of the right half is already in place */
+	memcpy(&tmp[k * size], &base[i * size], (half - i) * size);
+	memcpy(base, tmp, (k + half - i) * size);
+}
@@ -35,6 +35,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include "System/error.h"
+#include "System/hash.h"
 #include "System/mutator.h"
 #include "System/config.h"
 #include "../config.h"
@@ -73,62 +74,46 @@ typedef struct _ConfigSave
 } ConfigSave;
 
 
+/* prototypes */
+static void * _config_section_retain(void const * section);
+static void _config_section_release(void const * section);
+static void * _config_value_retain(void const * value);
+static void _config_value_release(void const * value);
+
+
 /* public */
 /* functions */
 /* config_new */
 Config * config_new(void)
 {
-	return mutator_new();
+	Config * config;
+
+	if((config = mutator_new()) == NULL)
+		return NULL;
+	hash_set_value_ownership(config, _config_section_retain,
+			_config_section_release);
+	return config;
 }
 
 
-/* config_new_copy */
-typedef struct _ConfigError
+/* config_new_concurrent */
+Config * config_new_concurrent(void)
 {
 	Config * config;
-	ErrorCode code;
-} ConfigError;
-static void _new_copy_foreach(Config const * from, String const * section,
-		void * priv);
-static void _new_copy_foreach_section(Config const * from,
-		String const * section, String const * variable,
-		String const * value, void * priv);
-
-Config * config_new_copy(Config const * from)
-{
-	ConfigError ce;
 
-	if((ce.config = mutator_new()) == NULL)
+	if((config = mutator_new_concurrent()) == NULL)
 		return NULL;
-	ce.code = 0;
-	config_foreach(from, _new_copy_foreach, &ce);
-	if(ce.code != 0)
-	{
-		config_delete(ce.config);
-		return NULL;
-	}
-	return ce.config;
+	hash_set_value_ownership(config, _config_section_retain,
+			_config_section_release);
+	return config;
 }
 
-static void _new_copy_foreach(Config const * from, String const * section,
-		void * priv)
-{
-	ConfigError * ce = (ConfigError *)priv;
-
-	if(ce->code == 0)
-		config_foreach_section(from, section, _new_copy_foreach_section,
-				ce);
-}
 
-static void _new_copy_foreach_section(Config const * from,
-		String const * section, String const * variable,
-		String const * value, void * priv)
+/* config_new_copy */
+Config * config_new_copy(Config const * from)
 {
-	ConfigError * ce = (ConfigError *)priv;
-	(void) from;
-
-	if(config_set(ce->config, section, variable, value) != 0)
-		ce->code = error_get_code();
+	/* the sections are shared until either configuration modifies them */
+	return mutator_new_copy(from);
 }
 
 
@@ -153,7 +138,6 @@ Config * config_new_load(String const * filename)
 /* config_delete */
 void config_delete(Config * config)
 {
-	config_reset(config);
 	mutator_delete(config);
 }
 
@@ -190,11 +174,61 @@ String const * config_get(Config const * config, String const * section,
 }
 
 
+/* config_get_stats */
+static void _get_stats_foreach(Config const * config, String const * section,
+		void * value, void * data);
+static void _get_stats_foreach_section(Mutator const * mutator,
+		String const * variable, void * value, void * data);
+
+void config_get_stats(Config const * config, HashStats * stats)
+{
+	mutator_get_stats(config, stats);
+	/* weigh the probe lengths by the number of entries */
+	stats->probe_avg *= stats->count;
+	mutator_foreach(config, _get_stats_foreach, stats);
+	stats->load = (stats->capacity > 0)
+		? (double)stats->count / stats->capacity : 0.0;
+	stats->probe_avg = (stats->count > 0)
+		? stats->probe_avg / stats->count : 0.0;
+}
+
+static void _get_stats_foreach(Config const * config, String const * section,
+		void * value, void * data)
+{
+	HashStats * stats = (HashStats *)data;
+	Mutator * mutator = (Mutator *)value;
+	HashStats s;
+	(void) config;
+	(void) section;
+
+	mutator_get_stats(mutator, &s);
+	stats->count += s.count;
+	stats->capacity += s.capacity;
+	stats->size += s.size;
+	stats->probe_avg += s.probe_avg * s.count;
+	if(s.probe_max > stats->probe_max)
+		stats->probe_max = s.probe_max;
+	stats->collisions += s.collisions;
+	mutator_foreach(mutator, _get_stats_foreach_section, stats);
+}
+
+static void _get_stats_foreach_section(Mutator const * mutator,
+		String const * variable, void * value, void * data)
+{
+	HashStats * stats = (HashStats *)data;
+	(void) mutator;
+	(void) variable;
+
+	stats->size += string_get_size((String const *)value);
+}
+
+
 /* config_set */
 int config_set(Config * config, String const * section, String const * variable,
 		String const * value)
 {
 	Mutator * mutator;
+	unsigned int h;
 	String * p;
 	String * newvalue = NULL;
 
@@ -207,31 +241,50 @@ int config_set(Config * config, String const * section, String const * variable,
 	if(variable == NULL || string_get_length(variable) == 0)
 		return error_set_code(-EINVAL, "variable: %s",
 				strerror(EINVAL));
-	if((mutator = (Mutator *)mutator_get(config, section)) == NULL)
+	/* stop sharing the sections with the copies */
+	if(hash_unshare(config) != 0)
+		return -1;
+	/* hash the keys only once */
+	h = hash_get_hash(config, section);
+	if((mutator = (Mutator *)mutator_get_prehashed(config, section, h))
+			== NULL)
 	{
-		/* create a new section */
-		if((mutator = mutator_new()) == NULL)
+		/* create a new section, sharing the variable names */
+		if((mutator = hash_is_concurrent(config)
+					? mutator_new_concurrent()
+					: mutator_new_interned()) == NULL)
 			return -1;
-		if(mutator_set(config, section, mutator) != 0)
+		hash_set_value_ownership(mutator, _config_value_retain,
+				_config_value_release);
+		if(mutator_set_prehashed(config, section, h, mutator) != 0)
 		{
 			mutator_delete(mutator);
 			return -1;
 		}
+		h = hash_get_hash(mutator, variable);
 		p = NULL;
 	}
-	else if((p = (String *)mutator_get(mutator, variable)) == NULL
-			&& value == NULL)
-		/* there is nothing to do */
-		return 0;
+	else
+	{
+		/* the former value must belong to this section */
+		if(hash_unshare(mutator) != 0)
+			return -1;
+		h = hash_get_hash(mutator, variable);
+		if((p = (String *)mutator_get_prehashed(mutator, variable, h))
+				== NULL && value == NULL)
+			/* there is nothing to do */
+			return 0;
+	}
 	if(value != NULL && (newvalue = string_new(value)) == NULL)
 		return -1;
-	if(mutator_set(mutator, variable, newvalue) != 0)
+	if(mutator_set_prehashed(mutator, variable, h, newvalue) != 0)
 	{
 		string_delete(newvalue);
 		return -1;
 	}
-	/* free the former value */
-	string_delete(p);
+	/* release the former value, once no reader can hold it anymore */
+	if(p != NULL)
+		hash_retire(mutator, p, _config_value_release);
 	return 0;
 }
 
@@ -497,41 +550,12 @@ int config_load_preferences_user(Config * config, String const * vendor,
 
 
 /* config_reset */
-static void _delete_foreach(Mutator const * mutator, String const * key,
-		void * value, void * data);
-static void _delete_foreach_section(Mutator const * mutator, String const * key,
-		void * value, void * data);
-
 int config_reset(Config * config)
 {
-	mutator_foreach(config, _delete_foreach, NULL);
+	/* the sections are freed along with the last copy */
 	return mutator_reset(config);
 }
 
-static void _delete_foreach(Mutator const * mutator, String const * key,
-		void * value, void * data)
-{
-	Mutator * m = (Mutator *)value;
-	(void) mutator;
-	(void) key;
-	(void) data;
-
-	/* free the values */
-	mutator_foreach(m, _delete_foreach_section, NULL);
-	mutator_delete(m);
-}
-
-static void _delete_foreach_section(Mutator const * mutator, String const * key,
-		void * value, void * data)
-{
-	String * v = (String *)value;
-	(void) mutator;
-	(void) key;
-	(void) data;
-
-	string_delete(v);
-}
-
 
 /* config_save */
 static void _save_foreach_default(Mutator const * mutator,
@@ -682,3 +706,33 @@ static int _save_preferences_user_mkdir(String * dir)
 	}
 	return 0;
 }
+
+
+/* private */
+/* functions */
+/* config_section_retain */
+static void * _config_section_retain(void const * section)
+{
+	return mutator_new_copy((Mutator const *)section);
+}
+
+
+/* config_section_release */
+static void _config_section_release(void const * section)
+{
+	mutator_delete((Mutator *)section);
+}
+
+
+/* config_value_retain */
+static void * _config_value_retain(void const * value)
+{
+	return string_new((String const *)value);
+}
+
+
+/* config_value_release */
+static void _config_value_release(void const * value)
+{
+	string_delete((String *)value);
+}
@@ -0,0 +1,280 @@
+/* $Id$ */
+/* Copyright (c) 2026 Pierre Pronchery <khorben@defora.org> */
+/* This file is part of DeforaOS System libSystem */
+/* All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "System/error.h"
+#include "System/object.h"
+#include "System/deque.h"
+
+
+/* constants */
+/* must be a power of two */
+#define DEQUE_CAPACITY_MIN	4
+
+
+/* Deque */
+/* protected */
+/* types */
+struct _Deque
+{
+	size_t head;
+	size_t count;
+	size_t capacity;
+	size_t size;
+	char * value;
+};
+
+
+/* prototypes */
+static DequeError _deque_grow(Deque * deque, size_t count);
+static DequeError _deque_resize(Deque * deque, size_t capacity);
+static char * _deque_slot(Deque const * deque, size_t pos);
+
+
+/* public */
+/* deque_new */
+Deque * deque_new(size_t size)
+{
+	Deque * deque;
+
+	if((deque = (Deque *)object_new(sizeof(*deque))) == NULL)
+		return NULL;
+	deque->head = 0;
+	deque->count = 0;
+	deque->capacity = 0;
+	deque->size = size;
+	deque->value = NULL;
+	return deque;
+}
+
+
+/* deque_delete */
+void deque_delete(Deque * deque)
+{
+	free(deque->value);
+	object_delete(deque);
+}
+
+
+/* accessors */
+/* deque_count */
+size_t deque_count(Deque const * deque)
+{
+	return deque->count;
+}
+
+
+/* deque_get */
+void * deque_get(Deque const * deque, size_t pos)
+{
+	if(pos >= deque->count)
+		return NULL;
+	return _deque_slot(deque, pos);
+}
+
+
+/* deque_get_back */
+void * deque_get_back(Deque const * deque)
+{
+	if(deque->count == 0)
+		return NULL;
+	return _deque_slot(deque, deque->count - 1);
+}
+
+
+/* deque_get_capacity */
+size_t deque_get_capacity(Deque const * deque)
+{
+	return deque->capacity;
+}
+
+
+/* deque_get_copy */
+DequeError deque_get_copy(Deque const * deque, size_t pos, DequeData * value)
+{
+	if(pos >= deque->count)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	memcpy(value, _deque_slot(deque, pos), deque->size);
+	return 0;
+}
+
+
+/* deque_get_front */
+void * deque_get_front(Deque const * deque)
+{
+	if(deque->count == 0)
+		return NULL;
+	return _deque_slot(deque, 0);
+}
+
+
+/* deque_get_size */
+size_t deque_get_size(Deque const * deque)
+{
+	return deque->size;
+}
+
+
+/* useful */
+/* deque_clear */
+void deque_clear(Deque * deque)
+{
+	deque->head = 0;
+	deque->count = 0;
+}
+
+
+/* deque_pop_back */
+DequeError deque_pop_back(Deque * deque, DequeData * value)
+{
+	if(deque->count == 0)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if(value != NULL)
+		memcpy(value, _deque_slot(deque, deque->count - 1),
+				deque->size);
+	if(--deque->count == 0)
+		deque->head = 0;
+	return 0;
+}
+
+
+/* deque_pop_front */
+DequeError deque_pop_front(Deque * deque, DequeData * value)
+{
+	if(deque->count == 0)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if(value != NULL)
+		memcpy(value, _deque_slot(deque, 0), deque->size);
+	if(--deque->count == 0)
+		deque->head = 0;
+	else
+		deque->head = (deque->head + 1) & (deque->capacity - 1);
+	return 0;
+}
+
+
+/* deque_push_back */
+DequeError deque_push_back(Deque * deque, DequeData * value)
+{
+	/* check for overflows */
+	if(deque->count == SIZE_MAX)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if(_deque_grow(deque, deque->count + 1) != 0)
+		return -1;
+	memcpy(_deque_slot(deque, deque->count), value, deque->size);
+	deque->count++;
+	return 0;
+}
+
+
+/* deque_push_front */
+DequeError deque_push_front(Deque * deque, DequeData * value)
+{
+	/* check for overflows */
+	if(deque->count == SIZE_MAX)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if(_deque_grow(deque, deque->count + 1) != 0)
+		return -1;
+	deque->head = (deque->head - 1) & (deque->capacity - 1);
+	memcpy(_deque_slot(deque, 0), value, deque->size);
+	deque->count++;
+	return 0;
+}
+
+
+/* deque_reserve */
+DequeError deque_reserve(Deque * deque, size_t count)
+{
+	return _deque_grow(deque, count);
+}
+
+
+/* private */
+/* functions */
+/* deque_grow */
+static DequeError _deque_grow(Deque * deque, size_t count)
+{
+	size_t capacity;
+
+	if(count <= deque->capacity)
+		return 0;
+	/* keep the capacity a power of two to wrap around with a mask */
+	capacity = (deque->capacity < DEQUE_CAPACITY_MIN)
+		? DEQUE_CAPACITY_MIN : deque->capacity;
+	while(capacity < count)
+	{
+		/* check for overflows */
+		if(capacity > SIZE_MAX / 2)
+			return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+		capacity *= 2;
+	}
+	return _deque_resize(deque, capacity);
+}
+
+
+/* deque_resize */
+static DequeError _deque_resize(Deque * deque, size_t capacity)
+{
+	char * p;
+	size_t size;
+	size_t n;
+
+	/* check for overflows */
+	if(deque->size != 0 && capacity > SIZE_MAX / deque->size)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if((size = capacity * deque->size) > 0)
+	{
+		if((p = (char *)realloc(deque->value, size)) == NULL)
+			return error_set_code(-errno, "%s", strerror(errno));
+		deque->value = p;
+		/* move the elements wrapped around to the end */
+		if(deque->head + deque->count > deque->capacity)
+		{
+			n = deque->capacity - deque->head;
+			memmove(&p[(capacity - n) * deque->size],
+					&p[deque->head * deque->size],
+					n * deque->size);
+			deque->head = capacity - n;
+		}
+	}
+	deque->capacity = capacity;
+	return 0;
+}
+
+
+/* deque_slot */
+static char * _deque_slot(Deque const * deque, size_t pos)
+{
+	return &deque->value[((deque->head + pos) & (deque->capacity - 1))
+		* deque->size];
+}
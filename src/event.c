@@ -35,6 +35,13 @@ typedef int suseconds_t; /* XXX */
 #else
 # include <sys/select.h>
 #endif
+#ifdef __linux__
+# include <sys/epoll.h>
+# define EVENT_EPOLL
+#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -59,60 +66,213 @@ typedef int suseconds_t; /* XXX */
 /* Event */
 /* private */
 /* types */
+/* first member of every registration */
+struct _EventHandle
+{
+	unsigned int type;
+};
+
 typedef struct _EventTimeout
 {
-	struct timeval initial;
-	struct timeval timeout;
+	EventHandle handle;
+	/* in nanoseconds, on the monotonic clock */
+	int64_t initial;
+	int64_t deadline;
 	EventTimeoutFunc func;
 	void * data;
+	/* position in the heap, or in the expired timeouts */
+	size_t pos;
+	bool expired;
 } EventTimeout;
 ARRAY2(EventTimeout *, eventtimeout)
 
 typedef struct _EventIO
 {
+	EventHandle handle;
 	int fd;
 	EventIOFunc func;
 	void * data;
+	/* freed once the callback is done running */
+	unsigned int busy;
+	bool cancelled;
+	struct _EventIO * prev;
+	struct _EventIO * next;
 } EventIO;
-ARRAY2(EventIO *, eventio)
+
+/* watchers, indexed by file descriptor */
+typedef struct _EventFD
+{
+	EventIO * reads;
+	EventIO * writes;
+} EventFD;
+ARRAY2(EventFD, eventfd)
+
+typedef struct _EventReady
+{
+	int fd;
+	unsigned int flags;
+} EventReady;
+ARRAY2(EventReady, eventready)
+
+/* backends */
+typedef struct _EventBackend
+{
+	char const * name;
+	int (*init)(Event * event);
+	void (*destroy)(Event * event);
+	/* changes the interest on fd between the flags given */
+	int (*set)(Event * event, int fd, unsigned int from, unsigned int to);
+	/* timeout in nanoseconds, or negative to wait indefinitely; the
+	 * descriptors ready are then listed in event->ready */
+	int (*wait)(Event * event, int64_t timeout);
+} EventBackend;
+
+typedef struct _EventSelect
+{
+	fd_set rfds;
+	fd_set wfds;
+} EventSelect;
+
+#ifdef EVENT_EPOLL
+typedef struct _EventEpoll
+{
+	int fd;
+	struct epoll_event * events;
+} EventEpoll;
+#endif
 
 struct _Event
 {
 	unsigned int loop;
 	int fdmax;
-	fd_set rfds;
-	fd_set wfds;
-	eventioArray * reads;
-	eventioArray * writes;
+	eventfdArray * fds;
+	eventreadyArray * ready;
+	/* min-heap on the deadlines */
 	eventtimeoutArray * timeouts;
-	struct timeval timeout;
+	/* timeouts being dispatched */
+	eventtimeoutArray * expired;
+	/* updated once per iteration after waiting, and outside of the
+	 * callbacks when adding timeouts */
+	int64_t now;
+	bool dispatching;
+	EventBackend const * backend;
+	union
+	{
+		EventSelect select;
+#ifdef EVENT_EPOLL
+		EventEpoll epoll;
+#endif
+	} u;
 };
 
 
+/* constants */
+#define EVENT_IO_READ		0x1
+#define EVENT_IO_WRITE		0x2
+#define EVENT_TIMEOUT		0x4
+
+#define EVENT_NSEC_PER_SEC	1000000000
+#define EVENT_NSEC_PER_USEC	1000
+
+#ifdef EVENT_EPOLL
+# define EVENT_EPOLL_EVENTS	256
+#endif
+
+
 /* prototypes */
 static int _event_loop_once(Event * event);
 
+static int64_t _event_time_add(int64_t time, int64_t delay);
+static int64_t _event_time_from_timeval(struct timeval const * tv);
+static int _event_time_now(int64_t * now);
+
+/* timeouts */
+static EventTimeout * _timeout_heap_top(Event * event);
+static int _timeout_heap_insert(Event * event, EventTimeout * et);
+static void _timeout_heap_make(Event * event);
+static void _timeout_heap_remove(Event * event, EventTimeout * et);
+static void _timeout_heap_down(EventTimeout ** ets, size_t count, size_t pos);
+static void _timeout_heap_up(EventTimeout ** ets, size_t pos);
+static void _timeout_heap_update(Event * event, EventTimeout * et);
+
+/* io */
+static unsigned int _io_get_flags(EventFD const * efd);
+static EventIO ** _io_get_list(EventFD * efd, unsigned int flag);
+static void _io_update(Event * event, int fd, unsigned int from);
+
+/* backends */
+static int _select_init(Event * event);
+static void _select_destroy(Event * event);
+static int _select_set(Event * event, int fd, unsigned int from,
+		unsigned int to);
+static int _select_wait(Event * event, int64_t timeout);
+
+#ifdef EVENT_EPOLL
+static int _epoll_init(Event * event);
+static void _epoll_destroy(Event * event);
+static int _epoll_set(Event * event, int fd, unsigned int from,
+		unsigned int to);
+static int _epoll_wait(Event * event, int64_t timeout);
+#endif
+
+
+/* variables */
+#ifdef EVENT_EPOLL
+static const EventBackend _event_backend_epoll =
+{
+	"epoll", _epoll_init, _epoll_destroy, _epoll_set, _epoll_wait
+};
+#endif
+static const EventBackend _event_backend_select =
+{
+	"select", _select_init, _select_destroy, _select_set, _select_wait
+};
+
+/* in order of preference */
+static EventBackend const * _event_backends[] =
+{
+#ifdef EVENT_EPOLL
+	&_event_backend_epoll,
+#endif
+	&_event_backend_select
+};
+
 
 /* public */
 /* functions */
 /* event_new */
 Event * event_new(void)
+{
+	return event_new_backend(NULL);
+}
+
+
+/* event_new_backend */
+static EventBackend const * _new_backend_init(Event * event,
+		char const * backend);
+
+Event * event_new_backend(char const * backend)
 {
 	Event * event;
 
 	if((event = (Event *)object_new(sizeof(*event))) == NULL)
 		return NULL;
+	if((event->backend = _new_backend_init(event, backend)) == NULL)
+	{
+		object_delete(event);
+		return NULL;
+	}
 	event->timeouts = eventtimeoutarray_new();
+	event->expired = eventtimeoutarray_new();
 	event->loop = 0;
 	event->fdmax = -1;
-	FD_ZERO(&event->rfds);
-	FD_ZERO(&event->wfds);
-	event->reads = eventioarray_new();
-	event->writes = eventioarray_new();
-	event->timeout.tv_sec = (time_t)LONG_MAX;
-	event->timeout.tv_usec = (suseconds_t)LONG_MAX;
-	if(event->timeouts == NULL || event->reads == NULL
-			|| event->writes == NULL)
+	event->now = 0;
+	event->dispatching = false;
+	event->fds = eventfdarray_new();
+	event->ready = eventreadyarray_new();
+	if(event->timeouts == NULL || event->expired == NULL
+			|| event->fds == NULL || event->ready == NULL
+			|| _event_time_now(&event->now) != 0)
 	{
 		event_delete(event);
 		return NULL;
@@ -120,42 +280,290 @@ Event * event_new(void)
 	return event;
 }
 
+static EventBackend const * _new_backend_init(Event * event,
+		char const * backend)
+{
+	size_t i;
+
+	for(i = 0; i < sizeof(_event_backends) / sizeof(*_event_backends);
+			i++)
+		if(backend == NULL)
+		{
+			/* fallback on the next backend available */
+			if(_event_backends[i]->init(event) == 0)
+				return _event_backends[i];
+		}
+		else if(strcmp(_event_backends[i]->name, backend) == 0)
+			return (_event_backends[i]->init(event) == 0)
+				? _event_backends[i] : NULL;
+	if(backend != NULL)
+		error_set_code(-ENOSYS, "%s: %s", backend,
+				"Unsupported event backend");
+	return NULL;
+}
+
 
 /* event_delete */
 void event_delete(Event * event)
 {
-	unsigned int i;
-	EventTimeout * et;
+	size_t i;
+	size_t count;
+	EventTimeout ** et;
+	EventFD * efd;
 	EventIO * eio;
 
-	for(i = 0; i < array_count(event->timeouts); i++)
+	if(event->timeouts != NULL)
 	{
-		array_get_copy(event->timeouts, i, &et);
-		object_delete(et);
+		et = array_get_data_mutable(event->timeouts, &count);
+		for(i = 0; i < count; i++)
+			object_delete(et[i]);
+		array_delete(event->timeouts);
 	}
-	array_delete(event->timeouts);
-	for(i = 0; i < array_count(event->reads); i++)
+	if(event->expired != NULL)
 	{
-		array_get_copy(event->reads, i, &eio);
-		object_delete(eio);
+		et = array_get_data_mutable(event->expired, &count);
+		for(i = 0; i < count; i++)
+			object_delete(et[i]);
+		array_delete(event->expired);
 	}
-	array_delete(event->reads);
-	for(i = 0; i < array_count(event->writes); i++)
+	if(event->fds != NULL)
 	{
-		array_get_copy(event->writes, i, &eio);
-		object_delete(eio);
+		efd = array_get_data_mutable(event->fds, &count);
+		for(i = 0; i < count; i++)
+		{
+			while((eio = efd[i].reads) != NULL)
+			{
+				efd[i].reads = eio->next;
+				object_delete(eio);
+			}
+			while((eio = efd[i].writes) != NULL)
+			{
+				efd[i].writes = eio->next;
+				object_delete(eio);
+			}
+		}
+		array_delete(event->fds);
 	}
-	array_delete(event->writes);
+	if(event->ready != NULL)
+		array_delete(event->ready);
+	event->backend->destroy(event);
 	object_delete(event);
 }
 
 
+/* accessors */
+/* event_get_backend */
+char const * event_get_backend(Event const * event)
+{
+	return event->backend->name;
+}
+
+
+/* event_set_io */
+int event_set_io(Event * event, EventHandle * handle, EventIOFunc func,
+		void * userdata)
+{
+	EventIO * eio = (EventIO *)handle;
+	(void) event;
+
+	if(handle->type != EVENT_IO_READ && handle->type != EVENT_IO_WRITE)
+		return error_set_code(-EINVAL, "%s", strerror(EINVAL));
+	eio->func = func;
+	eio->data = userdata;
+	return 0;
+}
+
+
+/* event_set_timeout */
+int event_set_timeout(Event * event, EventHandle * handle,
+		struct timeval * timeout)
+{
+	EventTimeout * et = (EventTimeout *)handle;
+
+	if(handle->type != EVENT_TIMEOUT)
+		return error_set_code(-EINVAL, "%s", strerror(EINVAL));
+	et->initial = _event_time_from_timeval(timeout);
+	/* re-armed as usual once dispatched */
+	if(et->expired)
+		return 0;
+	if(!event->dispatching && _event_time_now(&event->now) != 0)
+		return -1;
+	et->deadline = _event_time_add(event->now, et->initial);
+	_timeout_heap_update(event, et);
+	return 0;
+}
+
+
 /* useful */
+/* event_add_idle */
+EventHandle * event_add_idle(Event * event, EventTimeoutFunc func,
+		void * userdata)
+{
+	struct timeval tv;
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	return event_add_timeout(event, &tv, func, userdata);
+}
+
+
+/* event_add_io_read */
+static EventHandle * _add_io(Event * event, int fd, EventIOFunc func,
+		void * userdata, unsigned int flag);
+
+EventHandle * event_add_io_read(Event * event, int fd, EventIOFunc func,
+		void * userdata)
+{
+	return _add_io(event, fd, func, userdata, EVENT_IO_READ);
+}
+
+
+/* event_add_io_write */
+EventHandle * event_add_io_write(Event * event, int fd, EventIOFunc func,
+		void * userdata)
+{
+	return _add_io(event, fd, func, userdata, EVENT_IO_WRITE);
+}
+
+static EventHandle * _add_io(Event * event, int fd, EventIOFunc func,
+		void * userdata, unsigned int flag)
+{
+	EventIO * eventio;
+	EventIO ** p;
+	EventIO * prev = NULL;
+	EventFD * efd;
+	unsigned int from;
+
+	assert(fd >= 0);
+	if((size_t)fd >= array_count(event->fds)
+			&& array_resize(event->fds, (size_t)fd + 1) != 0)
+		return NULL;
+	if((eventio = (EventIO *)object_new(sizeof(*eventio))) == NULL)
+		return NULL;
+	efd = eventfdarray_get_mutable(event->fds, fd);
+	from = _io_get_flags(efd);
+	if((from & flag) == 0
+			&& event->backend->set(event, fd, from, from | flag)
+			!= 0)
+	{
+		object_delete(eventio);
+		return NULL;
+	}
+	eventio->handle.type = flag;
+	eventio->fd = fd;
+	eventio->func = func;
+	eventio->data = userdata;
+	eventio->busy = 0;
+	eventio->cancelled = false;
+	eventio->next = NULL;
+	/* keep the order of registration */
+	for(p = _io_get_list(efd, flag); *p != NULL; p = &prev->next)
+		prev = *p;
+	eventio->prev = prev;
+	*p = eventio;
+	event->fdmax = max(event->fdmax, fd);
+	return &eventio->handle;
+}
+
+
+/* event_add_timeout */
+EventHandle * event_add_timeout(Event * event, struct timeval * timeout,
+		EventTimeoutFunc func, void * userdata)
+{
+	EventTimeout * eventtimeout;
+
+	/* the time may have changed since the last iteration */
+	if(!event->dispatching && _event_time_now(&event->now) != 0)
+		return NULL;
+	if((eventtimeout = (EventTimeout *)object_new(sizeof(*eventtimeout)))
+			== NULL)
+		return NULL;
+	eventtimeout->handle.type = EVENT_TIMEOUT;
+	eventtimeout->initial = _event_time_from_timeval(timeout);
+	eventtimeout->deadline = _event_time_add(event->now,
+			eventtimeout->initial);
+	eventtimeout->func = func;
+	eventtimeout->data = userdata;
+	eventtimeout->expired = false;
+	if(_timeout_heap_insert(event, eventtimeout) != 0)
+	{
+		object_delete(eventtimeout);
+		return NULL;
+	}
+#ifdef DEBUG
+	fprintf(stderr, "DEBUG: %s%s%lld%s%ld%s", __func__, "() tv_sec=",
+			(long long)timeout->tv_sec, ", tv_usec=",
+			(long)timeout->tv_usec, "\n");
+#endif
+	return &eventtimeout->handle;
+}
+
+
+/* event_cancel */
+static int _cancel_io(Event * event, EventIO * eio);
+static int _cancel_timeout(Event * event, EventTimeout * et);
+
+int event_cancel(Event * event, EventHandle * handle)
+{
+	switch(handle->type)
+	{
+		case EVENT_IO_READ:
+		case EVENT_IO_WRITE:
+			return _cancel_io(event, (EventIO *)handle);
+		case EVENT_TIMEOUT:
+			return _cancel_timeout(event, (EventTimeout *)handle);
+	}
+	return error_set_code(-EINVAL, "%s", strerror(EINVAL));
+}
+
+static int _cancel_io(Event * event, EventIO * eio)
+{
+	EventFD * efd;
+	unsigned int from;
+
+	if(eio->busy > 0)
+	{
+		/* unlinked once the callback returns */
+		eio->cancelled = true;
+		return 0;
+	}
+	efd = eventfdarray_get_mutable(event->fds, eio->fd);
+	from = _io_get_flags(efd);
+	if(eio->prev != NULL)
+		eio->prev->next = eio->next;
+	else
+		*_io_get_list(efd, eio->handle.type) = eio->next;
+	if(eio->next != NULL)
+		eio->next->prev = eio->prev;
+	_io_update(event, eio->fd, from);
+	object_delete(eio);
+	return 0;
+}
+
+static int _cancel_timeout(Event * event, EventTimeout * et)
+{
+	EventTimeout ** ets;
+
+	if(et->expired)
+	{
+		/* being dispatched */
+		ets = array_get_data_mutable(event->expired, NULL);
+		ets[et->pos] = NULL;
+	}
+	else
+		_timeout_heap_remove(event, et);
+	object_delete(et);
+	return 0;
+}
+
+
 /* event_loop */
 int event_loop(Event * event)
 {
 	int ret;
 
+	if(_event_time_now(&event->now) != 0)
+		return -1;
 	event->loop++;
 	while(event->loop && (ret = _event_loop_once(event)) == 0);
 	return ret;
@@ -177,6 +585,8 @@ int event_loop_while(Event * event, const int * flag)
 
 	if(flag == NULL)
 		return event_loop(event);
+	if(_event_time_now(&event->now) != 0)
+		return -1;
 	event->loop++;
 	while(event->loop && *flag && (ret = _event_loop_once(event)) == 0);
 	return ret;
@@ -198,22 +608,7 @@ int event_register_idle(Event * event, EventTimeoutFunc func, void * data)
 int event_register_io_read(Event * event, int fd, EventIOFunc func,
 		void * userdata)
 {
-	EventIO * eventio;
-
-	assert(fd >= 0);
-	if((eventio = (EventIO *)object_new(sizeof(*eventio))) == NULL)
-		return 1;
-	eventio->fd = fd;
-	eventio->func = func;
-	eventio->data = userdata;
-	event->fdmax = max(event->fdmax, fd);
-	if(array_append(event->reads, &eventio) != 0)
-	{
-		object_delete(eventio);
-		return -1;
-	}
-	FD_SET(fd, &event->rfds);
-	return 0;
+	return (event_add_io_read(event, fd, func, userdata) != NULL) ? 0 : -1;
 }
 
 
@@ -221,22 +616,8 @@ int event_register_io_read(Event * event, int fd, EventIOFunc func,
 int event_register_io_write(Event * event, int fd, EventIOFunc func,
 		void * userdata)
 {
-	EventIO * eventio;
-
-	assert(fd >= 0);
-	if((eventio = (EventIO *)object_new(sizeof(*eventio))) == NULL)
-		return 1;
-	eventio->fd = fd;
-	eventio->func = func;
-	eventio->data = userdata;
-	event->fdmax = max(event->fdmax, fd);
-	if(array_append(event->writes, &eventio) != 0)
-	{
-		object_delete(eventio);
-		return -1;
-	}
-	FD_SET(fd, &event->wfds);
-	return 0;
+	return (event_add_io_write(event, fd, func, userdata) != NULL)
+		? 0 : -1;
 }
 
 
@@ -244,131 +625,75 @@ int event_register_io_write(Event * event, int fd, EventIOFunc func,
 int event_register_timeout(Event * event, struct timeval * timeout,
 		EventTimeoutFunc func, void * data)
 {
-	EventTimeout * eventtimeout;
-	struct timeval now;
-
-	if(gettimeofday(&now, NULL) != 0)
-		return error_set_code(-errno, "%s", strerror(errno));
-	if((eventtimeout = (EventTimeout *)object_new(sizeof(*eventtimeout)))
-			== NULL)
-		return -1;
-	eventtimeout->initial.tv_sec = timeout->tv_sec;
-	eventtimeout->initial.tv_usec = timeout->tv_usec;
-	eventtimeout->timeout.tv_sec = now.tv_sec + timeout->tv_sec;
-	eventtimeout->timeout.tv_usec = now.tv_usec + timeout->tv_usec;
-	eventtimeout->func = func;
-	eventtimeout->data = data;
-	if(array_append(event->timeouts, &eventtimeout) != 0)
-	{
-		object_delete(eventtimeout);
-		return -1;
-	}
-	if(event->timeout.tv_sec > timeout->tv_sec
-			|| (event->timeout.tv_sec == timeout->tv_sec
-				&& event->timeout.tv_usec > timeout->tv_usec))
-	{
-#ifdef DEBUG
-		fprintf(stderr, "DEBUG: %s%s%lld%s%ld%s", __func__, "() tv_sec=",
-				(long long)timeout->tv_sec, ", tv_usec=",
-				(long)timeout->tv_usec, "\n");
-#endif
-		event->timeout.tv_sec = timeout->tv_sec;
-		event->timeout.tv_usec = timeout->tv_usec;
-	}
-	return 0;
+	return (event_add_timeout(event, timeout, func, data) != NULL)
+		? 0 : -1;
 }
 
 
 /* event_unregister_io_read */
-static int _unregister_io(eventioArray * eios, fd_set * fds, int fd);
+static int _unregister_io(Event * event, int fd, unsigned int flag);
 
 int event_unregister_io_read(Event * event, int fd)
 {
-	event->fdmax = _unregister_io(event->reads, &event->rfds, fd);
-	event->fdmax = max(event->fdmax, _unregister_io(event->writes, NULL,
-				-1));
-	return 0;
+	return _unregister_io(event, fd, EVENT_IO_READ);
 }
 
 
 /* event_unregister_io_write */
 int event_unregister_io_write(Event * event, int fd)
 {
-	event->fdmax = _unregister_io(event->writes, &event->wfds, fd);
-	event->fdmax = max(event->fdmax, _unregister_io(event->reads, NULL,
-				-1));
-	return 0;
+	return _unregister_io(event, fd, EVENT_IO_WRITE);
 }
 
-static int _unregister_io(eventioArray * eios, fd_set * fds, int fd)
+static int _unregister_io(Event * event, int fd, unsigned int flag)
 {
-	unsigned int i = 0;
+	EventFD * efd;
 	EventIO * eio;
-	int fdmax = -1;
+	EventIO * next;
 
-	while(i < array_count(eios))
+	if(fd < 0 || (efd = eventfdarray_get_mutable(event->fds, fd)) == NULL)
+		return 0;
+	for(eio = *_io_get_list(efd, flag); eio != NULL; eio = next)
 	{
-		array_get_copy(eios, i, &eio);
-		if(eio->fd != fd)
-		{
-			fdmax = max(fdmax, eio->fd);
-			i++;
-			continue;
-		}
-		FD_CLR(fd, fds);
-		array_remove_pos(eios, i);
-		object_delete(eio);
+		next = eio->next;
+		_cancel_io(event, eio);
 	}
-	return fdmax;
+	return 0;
 }
 
 
 /* event_unregister_timeout */
 int event_unregister_timeout(Event * event, EventTimeoutFunc func)
 {
-	unsigned int i = 0;
-	EventTimeout * et;
-	struct timeval now;
+	size_t i;
+	size_t j;
+	size_t count;
+	EventTimeout ** ets;
 
-	while(i < array_count(event->timeouts))
-	{
-		array_get_copy(event->timeouts, i, &et);
-		if(et->func != func)
+	/* drop the matches and restore the heap in linear time */
+	ets = array_get_data_mutable(event->timeouts, &count);
+	for(i = 0, j = 0; i < count; i++)
+		if(ets[i]->func == func)
+			object_delete(ets[i]);
+		else
 		{
-			i++;
-			continue;
+			ets[j] = ets[i];
+			ets[j]->pos = j;
+			j++;
 		}
-		array_remove_pos(event->timeouts, i);
-		object_delete(et);
-	}
-	if(gettimeofday(&now, NULL) != 0)
-		return error_set_code(-errno, "%s", strerror(errno));
-	/* XXX will fail in 2038 on 32-bit platforms */
-	event->timeout.tv_sec = (time_t)LONG_MAX;
-	event->timeout.tv_usec = (suseconds_t)LONG_MAX;
-	for(i = 0; i < array_count(event->timeouts); i++)
+	if(j < count)
 	{
-		array_get_copy(event->timeouts, i, &et);
-		if(et->timeout.tv_sec < event->timeout.tv_sec
-				|| (et->timeout.tv_sec == event->timeout.tv_sec
-					&& et->timeout.tv_usec
-					< event->timeout.tv_usec))
+		array_remove_range(event->timeouts, j, count - j);
+		_timeout_heap_make(event);
+	}
+	/* the timeouts being dispatched are only marked */
+	ets = array_get_data_mutable(event->expired, &count);
+	for(i = 0; i < count; i++)
+		if(ets[i] != NULL && ets[i]->func == func)
 		{
-			if((event->timeout.tv_sec = et->timeout.tv_sec
-						- now.tv_sec) < 0)
-			{
-				event->timeout.tv_sec = 0;
-				event->timeout.tv_usec = 0;
-				break;
-			}
-			event->timeout.tv_usec = et->timeout.tv_usec
-				- now.tv_usec;
-			if(event->timeout.tv_usec >= 0)
-				continue;
-			event->timeout.tv_sec = max(0, event->timeout.tv_sec-1);
-			event->timeout.tv_usec = -event->timeout.tv_usec;
+			object_delete(ets[i]);
+			ets[i] = NULL;
 		}
-	}
 	return 0;
 }
 
@@ -377,124 +702,488 @@ int event_unregister_timeout(Event * event, EventTimeoutFunc func)
 /* functions */
 /* event_loop_once */
 static int _loop_timeout(Event * event);
-static void _loop_io(Event * event, eventioArray * eios, fd_set * fds);
+static void _loop_io(Event * event);
 
 static int _event_loop_once(Event * event)
 {
-	struct timeval tv = event->timeout;
-	struct timeval * timeout = (tv.tv_sec == (time_t)LONG_MAX
-			&& tv.tv_usec == (suseconds_t)LONG_MAX) ? NULL : &tv;
-	fd_set rfds = event->rfds;
-	fd_set wfds = event->wfds;
+	int64_t timeout = -1;
+	EventTimeout * et;
 
-	if(timeout != NULL || event->fdmax != -1)
+	if((et = _timeout_heap_top(event)) != NULL)
+		timeout = (et->deadline > event->now)
+			? et->deadline - event->now : 0;
+	if(timeout >= 0 || event->fdmax != -1)
 	{
-		if(select(event->fdmax + 1, &rfds, &wfds, NULL, timeout) < 0)
-			return error_set_code(-errno, "%s", strerror(errno));
+		if(event->backend->wait(event, timeout) != 0)
+			return -1;
+		if(_event_time_now(&event->now) != 0)
+			return -1;
+		event->dispatching = true;
 		if(_loop_timeout(event) != 0)
+		{
+			event->dispatching = false;
 			return -1;
-		_loop_io(event, event->reads, &rfds);
-		_loop_io(event, event->writes, &wfds);
-		if(event->timeout.tv_sec == (time_t)LONG_MAX
-				&& event->timeout.tv_usec
-				== (suseconds_t)LONG_MAX)
-			timeout = NULL;
-		else
-			timeout = &event->timeout;
+		}
+		_loop_io(event);
+		event->dispatching = false;
 	}
 	return 0;
 }
 
 static int _loop_timeout(Event * event)
 {
-	struct timeval now;
-	unsigned int i = 0;
+	int ret = 0;
+	size_t base;
+	size_t i;
+	size_t count;
+	EventTimeout ** ets;
 	EventTimeout * et;
+	int res;
 
-	if(gettimeofday(&now, NULL) != 0)
-		return error_set_code(-errno, "%s", strerror(errno));
-	event->timeout.tv_sec = (time_t)LONG_MAX;
-	event->timeout.tv_usec = (suseconds_t)LONG_MAX;
-	while(i < array_count(event->timeouts))
+	/* collect the expired timeouts first, so that each fires once */
+	base = array_count(event->expired);
+	while((et = _timeout_heap_top(event)) != NULL
+			&& et->deadline <= event->now)
 	{
-		array_get_copy(event->timeouts, i, &et);
-		if(now.tv_sec > et->timeout.tv_sec
-				|| (now.tv_sec == et->timeout.tv_sec
-					&& now.tv_usec >= et->timeout.tv_usec))
+		if(array_append(event->expired, &et) != 0)
+			break;
+		_timeout_heap_remove(event, et);
+		et->pos = array_count(event->expired) - 1;
+		et->expired = true;
+	}
+	for(i = base; i < array_count(event->expired); i++)
+	{
+		ets = array_get_data_mutable(event->expired, NULL);
+		if((et = ets[i]) == NULL)
+			continue;
+		res = et->func(et->data);
+		/* the callback may have unregistered this timeout */
+		ets = array_get_data_mutable(event->expired, NULL);
+		if(ets[i] == NULL)
+			continue;
+		ets[i] = NULL;
+		if(res != 0)
 		{
-			if(et->func(et->data) != 0)
-			{
-				array_remove_pos(event->timeouts, i);
-				object_delete(et);
-				continue;
-			}
-			et->timeout.tv_sec = et->initial.tv_sec + now.tv_sec;
-			et->timeout.tv_usec = et->initial.tv_usec + now.tv_usec;
-			if(et->initial.tv_sec < event->timeout.tv_sec
-					|| (et->initial.tv_sec
-						== event->timeout.tv_sec
-						&& et->initial.tv_usec
-						< event->timeout.tv_usec))
-			{
-				event->timeout.tv_sec = et->initial.tv_sec;
-				event->timeout.tv_usec = et->initial.tv_usec;
-			}
+			object_delete(et);
+			continue;
 		}
-		else
+		et->deadline = _event_time_add(event->now, et->initial);
+		et->expired = false;
+		if(_timeout_heap_insert(event, et) != 0)
 		{
-			if(et->timeout.tv_sec - now.tv_sec < event->timeout.tv_sec
-					|| (et->timeout.tv_sec - now.tv_sec == event->timeout.tv_sec
-						&& et->timeout.tv_usec - now.tv_usec < event->timeout.tv_usec))
-			{
-				event->timeout.tv_sec = et->timeout.tv_sec
-					- now.tv_sec;
-				/* XXX may be needed elsewhere too */
-				if(et->timeout.tv_usec >= now.tv_usec)
-					event->timeout.tv_usec
-						= et->timeout.tv_usec
-						- now.tv_usec;
-				else
-				{
-					event->timeout.tv_sec--;
-					event->timeout.tv_usec
-						= now.tv_usec
-						- et->timeout.tv_usec;
-				}
-			}
+			object_delete(et);
+			ret = -1;
 		}
-		i++;
 	}
-#ifdef DEBUG
-	fprintf(stderr, "DEBUG: %s() %s%lld%s%ld => 0\n", __func__, "tv_sec=",
-			(long long)event->timeout.tv_sec, ", tv_usec=",
-			(long)event->timeout.tv_usec);
-#endif
-	return 0;
+	if((count = array_count(event->expired)) > base)
+		array_remove_range(event->expired, base, count - base);
+	return ret;
 }
 
-static void _loop_io(Event * event, eventioArray * eios, fd_set * fds)
+static void _loop_io_fd(Event * event, int fd, unsigned int flag);
+
+static void _loop_io(Event * event)
 {
-	unsigned int i = 0;
-	EventIO * eio;
+	size_t i;
+	EventReady const * er;
 	int fd;
+	unsigned int flags;
 
-	while(i < array_count(eios))
+	for(i = 0; (er = eventreadyarray_get_const(event->ready, i)) != NULL; i++)
 	{
-		array_get_copy(eios, i, &eio);
-		if((fd = eio->fd) <= event->fdmax && FD_ISSET(fd, fds)
-				&& eio->func(fd, eio->data) != 0)
+		fd = er->fd;
+		flags = er->flags;
+		if(flags & EVENT_IO_READ)
+			_loop_io_fd(event, fd, EVENT_IO_READ);
+		if(flags & EVENT_IO_WRITE)
+			_loop_io_fd(event, fd, EVENT_IO_WRITE);
+	}
+}
+
+static void _loop_io_fd(Event * event, int fd, unsigned int flag)
+{
+	EventFD * efd;
+	EventIO * eio;
+	EventIO * next;
+	int res;
+
+	if((efd = eventfdarray_get_mutable(event->fds, fd)) == NULL)
+		return;
+	/* the callbacks may cancel any watcher, but the current one remains
+	 * linked until it returns */
+	for(eio = *_io_get_list(efd, flag); eio != NULL; eio = next)
+	{
+		if(eio->cancelled)
 		{
-			if(eios == event->reads)
-				event_unregister_io_read(event, fd);
-			else if(eios == event->writes)
-				event_unregister_io_write(event, fd);
-#ifdef DEBUG
-			else
-				fprintf(stderr, "DEBUG: %s%s", __func__,
-						"(): should not happen\n");
-#endif
+			next = eio->next;
+			continue;
 		}
-		else
-			i++;
+		eio->busy++;
+		res = eio->func(fd, eio->data);
+		eio->busy--;
+		next = eio->next;
+		if(res != 0 || eio->cancelled)
+			_cancel_io(event, eio);
 	}
 }
+
+
+/* io */
+
+/* io_get_flags */
+static unsigned int _io_get_flags(EventFD const * efd)
+{
+	return ((efd->reads != NULL) ? EVENT_IO_READ : 0)
+		| ((efd->writes != NULL) ? EVENT_IO_WRITE : 0);
+}
+
+
+/* io_get_list */
+static EventIO ** _io_get_list(EventFD * efd, unsigned int flag)
+{
+	return (flag == EVENT_IO_WRITE) ? &efd->writes : &efd->reads;
+}
+
+
+/* io_update */
+static void _io_update(Event * event, int fd, unsigned int from)
+{
+	unsigned int to;
+
+	to = _io_get_flags(eventfdarray_get_const(event->fds, fd));
+	if(to != from)
+		event->backend->set(event, fd, from, to);
+	/* only the highest descriptor removed requires a search */
+	for(; fd == event->fdmax && fd >= 0; event->fdmax = --fd)
+		if(_io_get_flags(eventfdarray_get_const(event->fds, fd)) != 0)
+			break;
+}
+
+/* time */
+/* event_time_add */
+static int64_t _event_time_add(int64_t time, int64_t delay)
+{
+	return (delay > INT64_MAX - time) ? INT64_MAX : time + delay;
+}
+
+
+/* event_time_from_timeval */
+static int64_t _event_time_from_timeval(struct timeval const * tv)
+{
+	int64_t usec;
+
+	/* tv_usec may exceed a second, or be negative */
+	if(tv->tv_sec < 0 || (usec = tv->tv_usec) < 0)
+		return 0;
+	if(tv->tv_sec >= INT64_MAX / EVENT_NSEC_PER_SEC - 1)
+		return INT64_MAX;
+	return _event_time_add((int64_t)tv->tv_sec * EVENT_NSEC_PER_SEC,
+			usec * EVENT_NSEC_PER_USEC);
+}
+
+
+/* event_time_now */
+static int _event_time_now(int64_t * now)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return error_set_code(-errno, "%s", strerror(errno));
+	*now = (int64_t)ts.tv_sec * EVENT_NSEC_PER_SEC + ts.tv_nsec;
+#else
+	struct timeval tv;
+
+	if(gettimeofday(&tv, NULL) != 0)
+		return error_set_code(-errno, "%s", strerror(errno));
+	*now = (int64_t)tv.tv_sec * EVENT_NSEC_PER_SEC
+		+ (int64_t)tv.tv_usec * EVENT_NSEC_PER_USEC;
+#endif
+	return 0;
+}
+
+
+/* timeouts */
+/* timeout_heap_top */
+static EventTimeout * _timeout_heap_top(Event * event)
+{
+	EventTimeout ** ets;
+
+	if((ets = array_get_data_mutable(event->timeouts, NULL)) == NULL)
+		return NULL;
+	return ets[0];
+}
+
+
+/* timeout_heap_insert */
+static int _timeout_heap_insert(Event * event, EventTimeout * et)
+{
+	et->pos = array_count(event->timeouts);
+	if(array_append(event->timeouts, &et) != 0)
+		return -1;
+	_timeout_heap_up(array_get_data_mutable(event->timeouts, NULL), et->pos);
+	return 0;
+}
+
+
+/* timeout_heap_make */
+static void _timeout_heap_make(Event * event)
+{
+	EventTimeout ** ets;
+	size_t count;
+	size_t i;
+
+	ets = array_get_data_mutable(event->timeouts, &count);
+	for(i = count / 2; i > 0; i--)
+		_timeout_heap_down(ets, count, i - 1);
+}
+
+
+/* timeout_heap_remove */
+static void _timeout_heap_remove(Event * event, EventTimeout * et)
+{
+	EventTimeout ** ets;
+	EventTimeout * last;
+	size_t count;
+	size_t pos = et->pos;
+
+	ets = array_get_data_mutable(event->timeouts, &count);
+	assert(pos < count && ets[pos] == et);
+	if(pos != --count)
+	{
+		last = ets[count];
+		ets[pos] = last;
+		last->pos = pos;
+		_timeout_heap_down(ets, count, pos);
+		_timeout_heap_up(ets, last->pos);
+	}
+	array_remove_pos(event->timeouts, count);
+}
+
+
+/* timeout_heap_down */
+static void _timeout_heap_down(EventTimeout ** ets, size_t count, size_t pos)
+{
+	EventTimeout * et = ets[pos];
+	size_t child;
+
+	while((child = pos * 2 + 1) < count)
+	{
+		if(child + 1 < count && ets[child + 1]->deadline
+				< ets[child]->deadline)
+			child++;
+		if(ets[child]->deadline >= et->deadline)
+			break;
+		ets[pos] = ets[child];
+		ets[pos]->pos = pos;
+		pos = child;
+	}
+	ets[pos] = et;
+	et->pos = pos;
+}
+
+
+/* timeout_heap_up */
+static void _timeout_heap_up(EventTimeout ** ets, size_t pos)
+{
+	EventTimeout * et = ets[pos];
+	size_t parent;
+
+	while(pos > 0)
+	{
+		parent = (pos - 1) / 2;
+		if(et->deadline >= ets[parent]->deadline)
+			break;
+		ets[pos] = ets[parent];
+		ets[pos]->pos = pos;
+		pos = parent;
+	}
+	ets[pos] = et;
+	et->pos = pos;
+}
+
+
+/* timeout_heap_update */
+static void _timeout_heap_update(Event * event, EventTimeout * et)
+{
+	EventTimeout ** ets;
+	size_t count;
+
+	ets = array_get_data_mutable(event->timeouts, &count);
+	_timeout_heap_down(ets, count, et->pos);
+	_timeout_heap_up(ets, et->pos);
+}
+
+/* backends */
+/* select */
+/* select_init */
+static int _select_init(Event * event)
+{
+	EventSelect * select = &event->u.select;
+
+	FD_ZERO(&select->rfds);
+	FD_ZERO(&select->wfds);
+	return 0;
+}
+
+
+/* select_destroy */
+static void _select_destroy(Event * event)
+{
+	(void) event;
+}
+
+
+/* select_set */
+static int _select_set(Event * event, int fd, unsigned int from,
+		unsigned int to)
+{
+	EventSelect * select = &event->u.select;
+
+	(void) from;
+#ifndef __WIN32__
+	if(to != 0 && fd >= FD_SETSIZE)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+#endif
+	if(to & EVENT_IO_READ)
+		FD_SET(fd, &select->rfds);
+	else
+		FD_CLR(fd, &select->rfds);
+	if(to & EVENT_IO_WRITE)
+		FD_SET(fd, &select->wfds);
+	else
+		FD_CLR(fd, &select->wfds);
+	return 0;
+}
+
+
+/* select_wait */
+static int _select_wait(Event * event, int64_t timeout)
+{
+	EventSelect * s = &event->u.select;
+	fd_set rfds = s->rfds;
+	fd_set wfds = s->wfds;
+	struct timeval tv;
+	int res;
+	int fd;
+	EventReady er;
+
+	array_resize(event->ready, 0);
+	if(timeout >= 0)
+	{
+		/* round up, not to wake up before the deadline */
+		timeout = _event_time_add(timeout, EVENT_NSEC_PER_USEC - 1);
+		tv.tv_sec = timeout / EVENT_NSEC_PER_SEC;
+		tv.tv_usec = (timeout % EVENT_NSEC_PER_SEC)
+			/ EVENT_NSEC_PER_USEC;
+	}
+	if((res = select(event->fdmax + 1, &rfds, &wfds, NULL,
+					(timeout >= 0) ? &tv : NULL)) < 0)
+		return error_set_code(-errno, "%s", strerror(errno));
+	for(fd = 0; res > 0 && fd <= event->fdmax; fd++)
+	{
+		er.fd = fd;
+		er.flags = (FD_ISSET(fd, &rfds) ? EVENT_IO_READ : 0)
+			| (FD_ISSET(fd, &wfds) ? EVENT_IO_WRITE : 0);
+		if(er.flags == 0)
+			continue;
+		res -= (er.flags == (EVENT_IO_READ | EVENT_IO_WRITE)) ? 2 : 1;
+		if(eventreadyarray_append(event->ready, er) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+
+#ifdef EVENT_EPOLL
+/* epoll */
+/* epoll_init */
+static int _epoll_init(Event * event)
+{
+	EventEpoll * epoll = &event->u.epoll;
+
+	if((epoll->fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		return error_set_code(-errno, "%s", strerror(errno));
+	if((epoll->events = malloc(sizeof(*epoll->events)
+					* EVENT_EPOLL_EVENTS)) == NULL)
+	{
+		close(epoll->fd);
+		return error_set_code(-errno, "%s", strerror(errno));
+	}
+	return 0;
+}
+
+
+/* epoll_destroy */
+static void _epoll_destroy(Event * event)
+{
+	EventEpoll * epoll = &event->u.epoll;
+
+	free(epoll->events);
+	close(epoll->fd);
+}
+
+
+/* epoll_set */
+static int _epoll_set(Event * event, int fd, unsigned int from,
+		unsigned int to)
+{
+	EventEpoll * epoll = &event->u.epoll;
+	struct epoll_event ev;
+	int op;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = ((to & EVENT_IO_READ) ? EPOLLIN : 0)
+		| ((to & EVENT_IO_WRITE) ? EPOLLOUT : 0);
+	ev.data.fd = fd;
+	op = (from == 0) ? EPOLL_CTL_ADD
+		: ((to == 0) ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+	if(epoll_ctl(epoll->fd, op, fd, &ev) == 0)
+		return 0;
+	/* the descriptor may have been closed and re-opened meanwhile */
+	if(op == EPOLL_CTL_DEL)
+		return 0;
+	if(op == EPOLL_CTL_MOD && errno == ENOENT
+			&& epoll_ctl(epoll->fd, EPOLL_CTL_ADD, fd, &ev) == 0)
+		return 0;
+	if(op == EPOLL_CTL_ADD && errno == EEXIST
+			&& epoll_ctl(epoll->fd, EPOLL_CTL_MOD, fd, &ev) == 0)
+		return 0;
+	return error_set_code(-errno, "%s", strerror(errno));
+}
+
+
+/* epoll_wait */
+static int _epoll_wait(Event * event, int64_t timeout)
+{
+	EventEpoll * epoll = &event->u.epoll;
+	EventReady * er;
+	uint32_t events;
+	int ms = -1;
+	int res;
+	int i;
+
+	array_resize(event->ready, 0);
+	/* round up, not to wake up before the deadline */
+	if(timeout >= 0)
+		ms = (timeout >= (int64_t)INT_MAX * 1000000) ? INT_MAX
+			: (timeout + 999999) / 1000000;
+	if((res = epoll_wait(epoll->fd, epoll->events, EVENT_EPOLL_EVENTS,
+					ms)) < 0)
+		return error_set_code(-errno, "%s", strerror(errno));
+	if(array_resize(event->ready, res) != 0)
+		return -1;
+	er = array_get_data_mutable(event->ready, NULL);
+	for(i = 0; i < res; i++)
+	{
+		er[i].fd = epoll->events[i].data.fd;
+		events = epoll->events[i].events;
+		/* like select(), hangups and errors wake up both directions */
+		er[i].flags = ((events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				? EVENT_IO_READ : 0)
+			| ((events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+					? EVENT_IO_WRITE : 0);
+	}
+	return 0;
+}
+#endif
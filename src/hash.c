@@ -25,69 +25,679 @@
  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
-
-
-
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include "System/array.h"
+#include <errno.h>
 #include "System/error.h"
 #include "System/object.h"
 #include "System/hash.h"
 
+/* constants */
+#define HASH_CAPACITY_MIN	8
+/* entries stored within the table itself */
+#define HASH_SMALL		8
+/* grow beyond 3/4 full */
+#define HASH_LOAD_NUM		3
+#define HASH_LOAD_DEN		4
+
+/* FNV-1a parameters */
+#define HASH_FNV32_BASIS	UINT32_C(2166136261)
+#define HASH_FNV32_PRIME	UINT32_C(16777619)
+#define HASH_FNV64_BASIS	UINT64_C(14695981039346656037)
+#define HASH_FNV64_PRIME	UINT64_C(1099511628211)
+
 
 /* HashEntry */
 /* private */
 /* types */
+/* entries are kept in insertion order, removed entries have no value */
 typedef struct _HashEntry
 {
 	unsigned int hash;
 	void const * key;
 	void * value;
 } HashEntry;
-ARRAY2(HashEntry, _hashentry)
-#define HashEntryArray _hashentryArray
+
+/* the entries allocated are shared between copies until either is modified,
+ * along with the buckets */
+typedef struct _HashShared
+{
+	atomic_size_t refcount;
+	HashEntry entries[];
+} HashShared;
+
+typedef struct _HashBucket
+{
+	unsigned int hash;
+	/* distance to the ideal bucket plus one, 0 if the bucket is empty */
+	unsigned int distance;
+	size_t pos;
+} HashBucket;
+
+
+/* HashTable */
+/* private */
+/* types */
+typedef struct _HashTable
+{
+	/* dense array of entries */
+	HashEntry * entries;
+	size_t entries_cnt;
+	size_t entries_size;
+	size_t count;
+
+	/* sparse index into the entries, with linear probing and Robin Hood
+	 * hashing */
+	HashBucket * buckets;
+	size_t capacity;
+
+	/* small tables are scanned linearly, without any allocation */
+	HashEntry small[HASH_SMALL];
+} HashTable;
 
 
 /* prototypes */
-static void _hashentry_init(HashEntry * he, HashFunc func, void const * key,
-		void * value);
+static void _hashtable_init(HashTable * table);
+static int _hashtable_init_copy(HashTable * table, HashTable const * from,
+		bool compact);
+static void _hashtable_destroy(HashTable * table);
+static void _hashtable_free(HashTable * table);
+static void _hashtable_share(HashTable * table, HashTable const * from);
+static bool _hashtable_unref(HashTable * table);
 
-/* accessors */
-static int _hashentry_set_value(HashEntry * he, void * value);
+static HashEntry * _hashtable_lookup(HashTable const * table,
+		HashCompare compare, unsigned int h, void const * key);
+static HashBucket * _hashtable_lookup_bucket(HashTable const * table,
+		HashCompare compare, unsigned int h, void const * key);
+static HashShared * _hashtable_get_shared(HashTable const * table);
+static void _hashtable_get_stats(HashTable const * table, HashStats * stats);
+static bool _hashtable_is_shared(HashTable const * table);
+static int _hashtable_reserve(HashTable * table, size_t count);
+static void _hashtable_reset(HashTable * table);
+static int _hashtable_set(HashTable * table, HashCompare compare,
+		void const * key, unsigned int h, void * value,
+		void const ** previous);
+
+static int _hashtable_grow(HashTable * table);
+static int _hashtable_grow_entries(HashTable * table);
+static int _hashtable_resize(HashTable * table, size_t capacity);
+static int _hashtable_resize_entries(HashTable * table, size_t size);
+static void _hashtable_compact(HashTable * table);
+static void _hashtable_index(HashTable * table, unsigned int h, size_t pos);
+static void _hashtable_reindex(HashTable * table);
+static void _hashtable_remove(HashTable * table, HashEntry * he);
+static void _hashtable_remove_bucket(HashTable * table, HashBucket * hb);
 
 
 /* functions */
-/* hashentry_init */
-static void _hashentry_init(HashEntry * he, HashFunc func, void const * key,
-		void * value)
+/* hashtable_init */
+static void _hashtable_init(HashTable * table)
 {
-	he->hash = (func != NULL) ? func(key) : 0;
-	he->key = key;
-	he->value = value;
+	table->entries = table->small;
+	table->entries_cnt = 0;
+	table->entries_size = HASH_SMALL;
+	table->count = 0;
+	table->buckets = NULL;
+	table->capacity = 0;
+}
+
+
+/* hashtable_init_copy */
+static int _hashtable_init_copy(HashTable * table, HashTable const * from,
+		bool compact)
+{
+	size_t i;
+
+	_hashtable_init(table);
+	if(!compact)
+	{
+		/* keep the positions of the entries as they are, and the
+		 * capacity reserved even if empty */
+		if(from->entries_size > table->entries_size
+				&& _hashtable_resize_entries(table,
+					from->entries_size) != 0)
+			return -1;
+		if(from->buckets != NULL && (table->buckets = (HashBucket *)
+					malloc(sizeof(*table->buckets)
+						* from->capacity)) == NULL)
+		{
+			_hashtable_destroy(table);
+			return error_set_code(-errno, "%s", strerror(errno));
+		}
+		memcpy(table->entries, from->entries, sizeof(*table->entries)
+				* from->entries_cnt);
+		if(from->buckets != NULL)
+			memcpy(table->buckets, from->buckets,
+					sizeof(*table->buckets)
+					* from->capacity);
+		table->entries_cnt = from->entries_cnt;
+		table->count = from->count;
+		table->capacity = from->capacity;
+		return 0;
+	}
+	if(from->count == 0)
+		return 0;
+	if(_hashtable_reserve(table, from->count) != 0)
+	{
+		_hashtable_destroy(table);
+		return -1;
+	}
+	/* leave the removed entries behind */
+	for(i = 0; i < from->entries_cnt; i++)
+		if(from->entries[i].value != NULL)
+			table->entries[table->entries_cnt++] = from->entries[i];
+	table->count = table->entries_cnt;
+	_hashtable_reindex(table);
+	return 0;
+}
+
+
+/* hashtable_destroy */
+static void _hashtable_destroy(HashTable * table)
+{
+	if(_hashtable_unref(table))
+		_hashtable_free(table);
+}
+
+
+/* hashtable_free */
+static void _hashtable_free(HashTable * table)
+{
+	free(_hashtable_get_shared(table));
+	free(table->buckets);
+}
+
+
+/* hashtable_share */
+static void _hashtable_share(HashTable * table, HashTable const * from)
+{
+	HashShared * shared;
+
+	if((shared = _hashtable_get_shared(from)) == NULL)
+		return;
+	atomic_fetch_add(&shared->refcount, 1);
+	*table = *from;
+}
+
+
+/* hashtable_unref */
+static bool _hashtable_unref(HashTable * table)
+{
+	HashShared * shared;
+
+	/* the last copy frees the entries and buckets */
+	return ((shared = _hashtable_get_shared(table)) == NULL
+			|| atomic_fetch_sub(&shared->refcount, 1) == 1)
+		? true : false;
 }
 
 
 /* accessors */
-/* hashentry_set_value */
-static int _hashentry_set_value(HashEntry * he, void * value)
+/* hashtable_lookup */
+static HashEntry * _hashtable_lookup(HashTable const * table,
+		HashCompare compare, unsigned int h, void const * key)
+{
+	size_t i;
+	HashEntry * he;
+	HashBucket * hb;
+
+	if(table->buckets == NULL)
+	{
+		/* compare the hashes first, removed entries have no key */
+		for(i = 0; i < table->entries_cnt; i++)
+		{
+			he = &table->entries[i];
+			if(he->hash == h && he->value != NULL
+					&& compare(he->key, key) == 0)
+				return he;
+		}
+		return NULL;
+	}
+	if((hb = _hashtable_lookup_bucket(table, compare, h, key)) == NULL)
+		return NULL;
+	return &table->entries[hb->pos];
+}
+
+
+/* hashtable_lookup_bucket */
+static HashBucket * _hashtable_lookup_bucket(HashTable const * table,
+		HashCompare compare, unsigned int h, void const * key)
+{
+	size_t mask = table->capacity - 1;
+	size_t i;
+	unsigned int distance;
+	HashBucket * hb;
+
+	if(table->count == 0)
+		return NULL;
+	for(i = h & mask, distance = 1;; i = (i + 1) & mask, distance++)
+	{
+		hb = &table->buckets[i];
+		/* the key would have displaced this entry if it existed */
+		if(hb->distance < distance)
+			return NULL;
+		if(hb->hash == h && compare(table->entries[hb->pos].key, key)
+				== 0)
+			return hb;
+	}
+}
+
+
+/* hashtable_get_shared */
+static HashShared * _hashtable_get_shared(HashTable const * table)
+{
+	if(table->entries == table->small)
+		return NULL;
+	return (HashShared *)((char *)table->entries
+			- offsetof(HashShared, entries));
+}
+
+
+/* hashtable_get_stats */
+static void _hashtable_get_stats(HashTable const * table, HashStats * stats)
+{
+	size_t probes = 0;
+	size_t i;
+	size_t j;
+	size_t mask = table->capacity - 1;
+	HashBucket const * hb;
+
+	stats->count = table->count;
+	stats->capacity = (table->buckets != NULL) ? table->capacity
+		: HASH_SMALL;
+	stats->size = sizeof(*table->buckets) * table->capacity;
+	if(table->entries != table->small)
+		stats->size += sizeof(*table->entries) * table->entries_size;
+	stats->load = (double)stats->count / stats->capacity;
+	stats->probe_max = 0;
+	stats->collisions = 0;
+	if(table->buckets == NULL)
+	{
+		/* every entry before is scanned, holes included */
+		for(i = 0; i < table->entries_cnt; i++)
+		{
+			if(table->entries[i].value == NULL)
+				continue;
+			probes += i + 1;
+			stats->probe_max = i + 1;
+		}
+		for(i = 0; i < table->entries_cnt; i++)
+			for(j = 0; j < i; j++)
+				if(table->entries[i].value != NULL
+						&& table->entries[j].value
+						!= NULL
+						&& table->entries[i].hash
+						== table->entries[j].hash)
+				{
+					stats->collisions++;
+					break;
+				}
+	}
+	else
+		for(i = 0; i < table->capacity; i++)
+		{
+			if((hb = &table->buckets[i])->distance == 0)
+				continue;
+			probes += hb->distance;
+			if(hb->distance > stats->probe_max)
+				stats->probe_max = hb->distance;
+			/* equal hashes are next to each other in the chain */
+			for(j = 1; j < hb->distance; j++)
+				if(table->buckets[(i - j) & mask].hash
+						== hb->hash)
+				{
+					stats->collisions++;
+					break;
+				}
+		}
+	stats->probe_avg = (stats->count > 0)
+		? (double)probes / stats->count : 0.0;
+}
+
+
+/* hashtable_is_shared */
+static bool _hashtable_is_shared(HashTable const * table)
+{
+	HashShared * shared;
+
+	return ((shared = _hashtable_get_shared(table)) != NULL
+			&& atomic_load(&shared->refcount) > 1) ? true : false;
+}
+
+
+/* useful */
+/* hashtable_reserve */
+static int _hashtable_reserve(HashTable * table, size_t count)
 {
+	size_t capacity;
+
+	if(count > SIZE_MAX / HASH_LOAD_DEN)
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	/* small tables do not need any index */
+	if(count <= HASH_SMALL && table->buckets == NULL)
+		capacity = 0;
+	else
+		for(capacity = HASH_CAPACITY_MIN; count * HASH_LOAD_DEN
+				> capacity * HASH_LOAD_NUM; capacity *= 2)
+			if(capacity > SIZE_MAX / 2 / sizeof(HashBucket))
+				return error_set_code(-ERANGE, "%s",
+						strerror(ERANGE));
+	if(capacity > table->capacity
+			&& _hashtable_resize(table, capacity) != 0)
+		return -1;
+	/* make room for the entries missing after the last one */
+	if(count > table->count && table->entries_cnt + count - table->count
+			> table->entries_size)
+		return _hashtable_resize_entries(table, table->entries_cnt
+				+ count - table->count);
+	return 0;
+}
+
+
+/* hashtable_reset */
+static void _hashtable_reset(HashTable * table)
+{
+	/* keep the allocations around for the next entries */
+	if(table->count != 0 && table->buckets != NULL)
+		memset(table->buckets, 0, sizeof(*table->buckets)
+				* table->capacity);
+	table->entries_cnt = 0;
+	table->count = 0;
+}
+
+
+/* hashtable_set */
+static int _hashtable_set(HashTable * table, HashCompare compare,
+		void const * key, unsigned int h, void * value,
+		void const ** previous)
+{
+	HashEntry * he;
+
+	*previous = NULL;
+	if((he = _hashtable_lookup(table, compare, h, key)) != NULL)
+	{
+		/* the former key is kept when replacing the value */
+		*previous = he->key;
+		if(value == NULL)
+			_hashtable_remove(table, he);
+		else
+			he->value = value;
+		return 0;
+	}
+	if(value == NULL)
+		return 0;
+	if(table->buckets == NULL)
+	{
+		/* switch to an index once the small table is full */
+		if(table->count == HASH_SMALL
+				&& _hashtable_reserve(table, HASH_SMALL + 1)
+				!= 0)
+			return 1;
+	}
+	else if((table->count + 1) * HASH_LOAD_DEN
+			> table->capacity * HASH_LOAD_NUM
+			&& _hashtable_grow(table) != 0)
+		return 1;
+	if(table->entries_cnt == table->entries_size
+			&& _hashtable_grow_entries(table) != 0)
+		return 1;
+	he = &table->entries[table->entries_cnt];
+	he->hash = h;
+	he->key = key;
 	he->value = value;
+	if(table->buckets != NULL)
+		_hashtable_index(table, h, table->entries_cnt);
+	table->entries_cnt++;
+	table->count++;
+	return 0;
+}
+
+
+/* hashtable_grow */
+static int _hashtable_grow(HashTable * table)
+{
+	if(table->capacity == 0)
+		return _hashtable_resize(table, HASH_CAPACITY_MIN);
+	if(table->capacity > SIZE_MAX / 2 / sizeof(HashBucket))
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	return _hashtable_resize(table, table->capacity * 2);
+}
+
+
+/* hashtable_grow_entries */
+static int _hashtable_grow_entries(HashTable * table)
+{
+	size_t size;
+
+	/* reclaim the removed entries if they are numerous enough, or if the
+	 * table is still small */
+	if((table->count <= table->entries_size / 2 && table->entries_size > 0)
+			|| (table->buckets == NULL
+				&& table->count < table->entries_size))
+	{
+		_hashtable_compact(table);
+		return 0;
+	}
+	if(table->entries_size == 0)
+		size = HASH_CAPACITY_MIN;
+	else if(table->entries_size > SIZE_MAX / 2 / sizeof(HashEntry))
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	else
+		size = table->entries_size * 2;
+	return _hashtable_resize_entries(table, size);
+}
+
+
+/* hashtable_resize */
+static int _hashtable_resize(HashTable * table, size_t capacity)
+{
+	HashBucket * buckets;
+
+	if((buckets = (HashBucket *)malloc(sizeof(*buckets) * capacity))
+			== NULL)
+		return error_set_code(-errno, "%s", strerror(errno));
+	free(table->buckets);
+	table->buckets = buckets;
+	table->capacity = capacity;
+	_hashtable_reindex(table);
+	return 0;
+}
+
+
+/* hashtable_resize_entries */
+static int _hashtable_resize_entries(HashTable * table, size_t size)
+{
+	HashShared * shared;
+
+	if(size > (SIZE_MAX - sizeof(*shared)) / sizeof(*shared->entries))
+		return error_set_code(-ERANGE, "%s", strerror(ERANGE));
+	if(table->entries == table->small)
+	{
+		/* move the entries out of the table */
+		if((shared = (HashShared *)malloc(sizeof(*shared)
+						+ sizeof(*shared->entries)
+						* size)) == NULL)
+			return error_set_code(-errno, "%s", strerror(errno));
+		atomic_init(&shared->refcount, 1);
+		memcpy(shared->entries, table->small, sizeof(*shared->entries)
+				* table->entries_cnt);
+	}
+	else if((shared = (HashShared *)realloc(_hashtable_get_shared(table),
+					sizeof(*shared)
+					+ sizeof(*shared->entries) * size))
+			== NULL)
+		return error_set_code(-errno, "%s", strerror(errno));
+	table->entries = shared->entries;
+	table->entries_size = size;
 	return 0;
 }
 
 
+/* hashtable_compact */
+static void _hashtable_compact(HashTable * table)
+{
+	size_t i;
+	size_t j;
+
+	for(i = 0, j = 0; i < table->entries_cnt; i++)
+		if(table->entries[i].value != NULL)
+			table->entries[j++] = table->entries[i];
+	table->entries_cnt = j;
+	_hashtable_reindex(table);
+}
+
+
+/* hashtable_index */
+static void _hashtable_index(HashTable * table, unsigned int h, size_t pos)
+{
+	HashBucket * buckets = table->buckets;
+	size_t mask = table->capacity - 1;
+	size_t i;
+	HashBucket hb;
+	HashBucket tmp;
+
+	hb.hash = h;
+	hb.pos = pos;
+	/* there is always room left, as enforced by the load factor */
+	for(i = h & mask, hb.distance = 1;; i = (i + 1) & mask, hb.distance++)
+	{
+		if(buckets[i].distance == 0)
+		{
+			buckets[i] = hb;
+			return;
+		}
+		/* take from the rich: displace entries closer to home */
+		if(buckets[i].distance < hb.distance)
+		{
+			tmp = buckets[i];
+			buckets[i] = hb;
+			hb = tmp;
+		}
+	}
+}
+
+
+/* hashtable_reindex */
+static void _hashtable_reindex(HashTable * table)
+{
+	size_t i;
+
+	if(table->buckets == NULL)
+		return;
+	memset(table->buckets, 0, sizeof(*table->buckets) * table->capacity);
+	for(i = 0; i < table->entries_cnt; i++)
+		if(table->entries[i].value != NULL)
+			_hashtable_index(table, table->entries[i].hash, i);
+}
+
+
+/* hashtable_remove */
+static void _hashtable_remove(HashTable * table, HashEntry * he)
+{
+	HashBucket * hb;
+	size_t mask = table->capacity - 1;
+	size_t i;
+
+	if(table->buckets != NULL)
+	{
+		/* look for the bucket pointing to this entry */
+		for(i = he->hash & mask;; i = (i + 1) & mask)
+			if((hb = &table->buckets[i])->pos
+					== (size_t)(he - table->entries))
+				break;
+		_hashtable_remove_bucket(table, hb);
+	}
+	/* leave a hole in the entries, reclaimed when growing */
+	he->key = NULL;
+	he->value = NULL;
+	table->count--;
+	/* the last entries can be dropped right away */
+	while(table->entries_cnt > 0
+			&& table->entries[table->entries_cnt - 1].value == NULL)
+		table->entries_cnt--;
+}
+
+
+/* hashtable_remove_bucket */
+static void _hashtable_remove_bucket(HashTable * table, HashBucket * hb)
+{
+	size_t mask = table->capacity - 1;
+	size_t i = hb - table->buckets;
+	size_t j;
+
+	/* shift the following buckets back instead of leaving a tombstone */
+	for(j = (i + 1) & mask; table->buckets[j].distance > 1;
+			i = j, j = (j + 1) & mask)
+	{
+		table->buckets[i] = table->buckets[j];
+		table->buckets[i].distance--;
+	}
+	table->buckets[i].distance = 0;
+}
+
+
 /* Hash */
 /* protected */
 /* types */
+/* readers only take a reference on the current table, while writers modify
+ * a copy of it, publish it and wait for the former readers to be done */
+typedef struct _HashRetired
+{
+	void const * data;
+	HashRelease release;
+} HashRetired;
+
+typedef struct _HashConcurrent
+{
+	pthread_mutex_t mutex;
+	HashTable * _Atomic table;
+	atomic_uint epoch;
+	atomic_size_t readers[2];
+
+	/* released once the hash is reset or deleted */
+	HashRetired * retired;
+	size_t retired_cnt;
+	size_t retired_size;
+} HashConcurrent;
+
 struct _Hash
 {
 	HashFunc func;
+	HashFuncSeed func_seed;
+	uint64_t seed;
 	HashCompare compare;
-	HashEntryArray * entries;
+	HashTable table;
+	HashConcurrent * concurrent;
+
+	/* ownership of the entries, for the copies of the table */
+	HashRetain key_retain;
+	HashRelease key_release;
+	HashRetain value_retain;
+	HashRelease value_release;
 };
 
 
+/* prototypes */
+static unsigned int _hash_hash(Hash const * hash, void const * key);
+
+static void _hash_destroy(Hash const * hash, HashTable * table);
+static void _hash_release(Hash const * hash, HashTable const * table);
+static int _hash_retain(Hash const * hash, HashTable * table);
+static int _hash_unshare(Hash * hash);
+
+static HashTable const * _hash_read_begin(Hash const * hash,
+		unsigned int * epoch);
+static void _hash_read_end(Hash const * hash, unsigned int epoch);
+static HashTable * _hash_write_begin(Hash * hash);
+static int _hash_write_end(Hash * hash, HashTable * table, int ret,
+		bool release);
+static void _hash_release_retired(Hash * hash);
+
+
 /* public */
 /* functions */
 /* hash_new */
@@ -102,13 +712,91 @@ Hash * hash_new(HashFunc func, HashCompare compare)
 	}
 	if((hash = (Hash *)object_new(sizeof(*hash))) == NULL)
 		return NULL;
-	if((hash->entries = _hashentryarray_new()) == NULL)
+	hash->func = func;
+	hash->func_seed = NULL;
+	hash->seed = 0;
+	hash->compare = compare;
+	_hashtable_init(&hash->table);
+	hash->concurrent = NULL;
+	hash->key_retain = NULL;
+	hash->key_release = NULL;
+	hash->value_retain = NULL;
+	hash->value_release = NULL;
+	return hash;
+}
+
+
+/* hash_new_capacity */
+Hash * hash_new_capacity(HashFunc func, HashCompare compare, size_t capacity)
+{
+	Hash * hash;
+
+	if((hash = hash_new(func, compare)) == NULL)
+		return NULL;
+	if(hash_reserve(hash, capacity) != 0)
 	{
-		object_delete(hash);
+		hash_delete(hash);
 		return NULL;
 	}
-	hash->func = func;
-	hash->compare = compare;
+	return hash;
+}
+
+
+/* hash_new_concurrent */
+Hash * hash_new_concurrent(HashFunc func, HashCompare compare)
+{
+	Hash * hash;
+	HashConcurrent * hc;
+	HashTable * table;
+
+	if((hash = hash_new(func, compare)) == NULL)
+		return NULL;
+	if((hc = (HashConcurrent *)object_new(sizeof(*hc))) == NULL)
+	{
+		hash_delete(hash);
+		return NULL;
+	}
+	if((table = (HashTable *)object_new(sizeof(*table))) == NULL)
+	{
+		object_delete(hc);
+		hash_delete(hash);
+		return NULL;
+	}
+	if((errno = pthread_mutex_init(&hc->mutex, NULL)) != 0)
+	{
+		error_set_code(-errno, "%s", strerror(errno));
+		object_delete(table);
+		object_delete(hc);
+		hash_delete(hash);
+		return NULL;
+	}
+	_hashtable_init(table);
+	atomic_init(&hc->table, table);
+	atomic_init(&hc->epoch, 0);
+	atomic_init(&hc->readers[0], 0);
+	atomic_init(&hc->readers[1], 0);
+	hc->retired = NULL;
+	hc->retired_cnt = 0;
+	hc->retired_size = 0;
+	hash->concurrent = hc;
+	return hash;
+}
+
+
+/* hash_new_seed */
+Hash * hash_new_seed(HashFuncSeed func, uint64_t seed, HashCompare compare)
+{
+	Hash * hash;
+
+	if(func == NULL)
+	{
+		error_set_code(1, "%s", "Invalid hashing function");
+		return NULL;
+	}
+	if((hash = hash_new(NULL, compare)) == NULL)
+		return NULL;
+	hash->func_seed = func;
+	hash->seed = seed;
 	return hash;
 }
 
@@ -117,16 +805,36 @@ Hash * hash_new(HashFunc func, HashCompare compare)
 Hash * hash_new_copy(Hash const * from)
 {
 	Hash * hash;
+	HashTable const * table;
+	unsigned int epoch;
+	int res;
 
-	if((hash = (Hash *)object_new(sizeof(*from))) == NULL)
+	if((hash = hash_new(from->func, from->compare)) == NULL)
 		return NULL;
-	if((hash->entries = array_new_copy(from->entries)) == NULL)
+	hash->func_seed = from->func_seed;
+	hash->seed = from->seed;
+	hash->key_retain = from->key_retain;
+	hash->key_release = from->key_release;
+	hash->value_retain = from->value_retain;
+	hash->value_release = from->value_release;
+	/* share the entries until either hash is modified */
+	if(from->concurrent == NULL && _hashtable_get_shared(&from->table)
+			!= NULL)
+	{
+		_hashtable_share(&hash->table, &from->table);
+		return hash;
+	}
+	/* the copy is never concurrent */
+	table = _hash_read_begin(from, &epoch);
+	if((res = _hashtable_init_copy(&hash->table, table, true)) == 0
+			&& (res = _hash_retain(hash, &hash->table)) != 0)
+		_hashtable_destroy(&hash->table);
+	_hash_read_end(from, epoch);
+	if(res != 0)
 	{
 		object_delete(hash);
 		return NULL;
 	}
-	hash->func = from->func;
-	hash->compare = from->compare;
 	return hash;
 }
 
@@ -134,7 +842,19 @@ Hash * hash_new_copy(Hash const * from)
 /* hash_delete */
 void hash_delete(Hash * hash)
 {
-	array_delete(hash->entries);
+	HashConcurrent * hc;
+	HashTable * table;
+
+	if((hc = hash->concurrent) != NULL)
+	{
+		_hash_release_retired(hash);
+		table = atomic_load(&hc->table);
+		_hash_destroy(hash, table);
+		object_delete(table);
+		pthread_mutex_destroy(&hc->mutex);
+		object_delete(hc);
+	}
+	_hash_destroy(hash, &hash->table);
 	object_delete(hash);
 }
 
@@ -143,12 +863,35 @@ void hash_delete(Hash * hash)
 /* hash_func_string */
 unsigned int hash_func_string(void const * key)
 {
-	String const * str = (String const *)key;
-	size_t i;
-	unsigned int hash = 0;
+	unsigned char const * str = (unsigned char const *)key;
+	uint32_t hash = HASH_FNV32_BASIS;
 
-	for(i = 0; i < sizeof(hash) && str[i] != '\0'; i++)
-		hash |= str[i] << (i << 3);
+	/* FNV-1a over the whole string */
+	for(; *str != '\0'; str++)
+		hash = (hash ^ *str) * HASH_FNV32_PRIME;
+	/* finalize to spread the low bits used for the buckets */
+	hash ^= hash >> 16;
+	hash *= UINT32_C(0x85ebca6b);
+	hash ^= hash >> 13;
+	hash *= UINT32_C(0xc2b2ae35);
+	hash ^= hash >> 16;
+	return hash;
+}
+
+
+/* hash_func_string64 */
+uint64_t hash_func_string64(void const * key, uint64_t seed)
+{
+	unsigned char const * str = (unsigned char const *)key;
+	uint64_t hash = HASH_FNV64_BASIS ^ seed;
+
+	for(; *str != '\0'; str++)
+		hash = (hash ^ *str) * HASH_FNV64_PRIME;
+	hash ^= hash >> 33;
+	hash *= UINT64_C(0xff51afd7ed558ccd);
+	hash ^= hash >> 33;
+	hash *= UINT64_C(0xc4ceb9fe1a85ec53);
+	hash ^= hash >> 33;
 	return hash;
 }
 
@@ -167,124 +910,542 @@ int hash_compare_string(void const * value1, void const * value2)
 /* hash_count */
 size_t hash_count(Hash const * hash)
 {
-	return array_count((Array const *)hash->entries);
+	size_t ret;
+	HashTable const * table;
+	unsigned int epoch;
+
+	table = _hash_read_begin(hash, &epoch);
+	ret = table->count;
+	_hash_read_end(hash, epoch);
+	return ret;
 }
 
 
 /* hash_get */
 void * hash_get(Hash const * hash, void const * key)
 {
-	Array const * entries = (Array const *)hash->entries;
-	unsigned int h;
+	return hash_get_prehashed(hash, key, _hash_hash(hash, key));
+}
+
+
+/* hash_get_prehashed */
+void * hash_get_prehashed(Hash const * hash, void const * key, unsigned int h)
+{
+	void * ret = NULL;
+	HashTable const * table;
+	unsigned int epoch;
+	HashEntry * he;
+
+	table = _hash_read_begin(hash, &epoch);
+	if((he = _hashtable_lookup(table, hash->compare, h, key)) != NULL)
+		ret = he->value;
+	_hash_read_end(hash, epoch);
+	if(ret == NULL)
+		error_set_code(1, "%s", "Key not found");
+	return ret;
+}
+
+
+/* hash_get_compare */
+HashCompare hash_get_compare(Hash const * hash)
+{
+	return hash->compare;
+}
+
+
+/* hash_get_hash */
+unsigned int hash_get_hash(Hash const * hash, void const * key)
+{
+	return _hash_hash(hash, key);
+}
+
+
+/* hash_get_key */
+void const * hash_get_key(Hash const * hash, void const * key)
+{
+	void const * ret;
+
+	if((ret = hash_get_key_prehashed(hash, key, _hash_hash(hash, key)))
+			== NULL)
+		error_set_code(1, "%s", "Key not found");
+	return ret;
+}
+
+
+/* hash_get_key_prehashed */
+void const * hash_get_key_prehashed(Hash const * hash, void const * key,
+		unsigned int h)
+{
+	void const * ret = NULL;
+	HashTable const * table;
+	unsigned int epoch;
+	HashEntry * he;
+
+	table = _hash_read_begin(hash, &epoch);
+	if((he = _hashtable_lookup(table, hash->compare, h, key)) != NULL)
+		ret = he->key;
+	_hash_read_end(hash, epoch);
+	return ret;
+}
+
+
+/* hash_get_stats */
+void hash_get_stats(Hash const * hash, HashStats * stats)
+{
+	HashTable const * table;
+	unsigned int epoch;
+
+	table = _hash_read_begin(hash, &epoch);
+	_hashtable_get_stats(table, stats);
+	_hash_read_end(hash, epoch);
+	stats->size += sizeof(*hash);
+	if(hash->concurrent != NULL)
+		stats->size += sizeof(*hash->concurrent) + sizeof(*table);
+}
+
+
+/* hash_is_concurrent */
+bool hash_is_concurrent(Hash const * hash)
+{
+	return (hash->concurrent != NULL) ? true : false;
+}
+
+
+/* hash_set */
+int hash_set(Hash * hash, void const * key, void * value)
+{
+	return hash_set_prehashed(hash, key, _hash_hash(hash, key), value);
+}
+
+
+/* hash_set_prehashed */
+int hash_set_prehashed(Hash * hash, void const * key, unsigned int h,
+		void * value)
+{
+	void const * previous;
+
+	return hash_set_key_prehashed(hash, key, h, value, &previous);
+}
+
+
+/* hash_set_key_prehashed */
+int hash_set_key_prehashed(Hash * hash, void const * key, unsigned int h,
+		void * value, void const ** previous)
+{
+	HashTable * table;
+	HashTable const * t;
+	unsigned int epoch;
+	HashEntry * he;
+
+	*previous = NULL;
+	if((hash->concurrent != NULL || _hashtable_is_shared(&hash->table))
+			&& value == NULL)
+	{
+		/* avoid copying the table for nothing */
+		t = _hash_read_begin(hash, &epoch);
+		he = _hashtable_lookup(t, hash->compare, h, key);
+		_hash_read_end(hash, epoch);
+		if(he == NULL)
+			return 0;
+	}
+	if((table = _hash_write_begin(hash)) == NULL)
+		return 1;
+	/* the lookup happens again while holding the lock */
+	return _hash_write_end(hash, table, _hashtable_set(table,
+				hash->compare, key, h, value, previous), false);
+}
+
+
+/* hash_set_key_ownership */
+void hash_set_key_ownership(Hash * hash, HashRetain retain,
+		HashRelease release)
+{
+	hash->key_retain = retain;
+	hash->key_release = release;
+}
+
+
+/* hash_set_value_ownership */
+void hash_set_value_ownership(Hash * hash, HashRetain retain,
+		HashRelease release)
+{
+	hash->value_retain = retain;
+	hash->value_release = release;
+}
+
+
+/* hash_key_init */
+void hash_key_init(HashKey * hk, Hash const * hash, void const * key)
+{
+	hk->key = key;
+	hk->hash = _hash_hash(hash, key);
+}
+
+
+/* useful */
+/* hash_foreach */
+void hash_foreach(Hash const * hash, HashForeach func, void * data)
+{
+	HashTable const * table;
+	unsigned int epoch;
 	size_t i;
 	HashEntry * he;
 
-	h = (hash->func != NULL) ? hash->func(key) : 0;
-	for(i = array_count(entries); i > 0; i--)
+	/* the callback must not modify concurrent tables */
+	table = _hash_read_begin(hash, &epoch);
+	for(i = 0; i < table->entries_cnt; i++)
 	{
-		if((he = (HashEntry *)array_get(entries, i - 1)) == NULL)
-			return NULL;
-		if(he->hash != h)
-			continue;
-		if(hash->compare(he->key, key) == 0)
-			return he->value;
+		he = &table->entries[i];
+		if(he->value != NULL)
+			func(hash, he->key, he->value, data);
 	}
-	error_set_code(1, "%s", "Key not found");
-	return NULL;
+	_hash_read_end(hash, epoch);
 }
 
 
-/* hash_get_key */
-void const * hash_get_key(Hash const * hash, void const * key)
+/* hash_iter_begin */
+void hash_iter_begin(Hash const * hash, HashIterator * iterator)
+{
+	iterator->hash = hash;
+	iterator->pos = 0;
+}
+
+
+/* hash_iter_key */
+void const * hash_iter_key(HashIterator const * iterator)
+{
+	Hash const * hash = iterator->hash;
+	HashTable const * table = (hash->concurrent != NULL)
+		? atomic_load(&hash->concurrent->table) : &hash->table;
+
+	return table->entries[iterator->pos - 1].key;
+}
+
+
+/* hash_iter_next */
+bool hash_iter_next(HashIterator * iterator)
+{
+	Hash const * hash = iterator->hash;
+	/* concurrent tables must not be modified while iterating */
+	HashTable const * table = (hash->concurrent != NULL)
+		? atomic_load(&hash->concurrent->table) : &hash->table;
+
+	/* pos is one past the current entry */
+	while(iterator->pos < table->entries_cnt)
+		if(table->entries[iterator->pos++].value != NULL)
+			return true;
+	return false;
+}
+
+
+/* hash_iter_value */
+void * hash_iter_value(HashIterator const * iterator)
+{
+	Hash const * hash = iterator->hash;
+	HashTable const * table = (hash->concurrent != NULL)
+		? atomic_load(&hash->concurrent->table) : &hash->table;
+
+	return table->entries[iterator->pos - 1].value;
+}
+
+
+/* hash_reserve */
+int hash_reserve(Hash * hash, size_t count)
+{
+	HashTable * table;
+
+	if((table = _hash_write_begin(hash)) == NULL)
+		return -1;
+	return _hash_write_end(hash, table, _hashtable_reserve(table, count),
+			false);
+}
+
+
+/* hash_reset */
+int hash_reset(Hash * hash)
+{
+	HashTable * table;
+
+	if(hash->concurrent == NULL)
+	{
+		if(_hashtable_is_shared(&hash->table))
+		{
+			/* leave the entries to the other copies */
+			_hash_destroy(hash, &hash->table);
+			_hashtable_init(&hash->table);
+		}
+		else
+		{
+			_hash_release(hash, &hash->table);
+			_hashtable_reset(&hash->table);
+		}
+		return 0;
+	}
+	if((table = _hash_write_begin(hash)) == NULL)
+		return 1;
+	_hashtable_reset(table);
+	_hash_write_end(hash, table, 0, true);
+	_hash_release_retired(hash);
+	return 0;
+}
+
+
+/* hash_retire */
+int hash_retire(Hash * hash, void const * data, HashRelease release)
+{
+	HashConcurrent * hc = hash->concurrent;
+	HashRetired * p;
+	size_t size;
+
+	if(hc == NULL)
+	{
+		/* there is no other reader */
+		release(data);
+		return 0;
+	}
+	pthread_mutex_lock(&hc->mutex);
+	if(hc->retired_cnt == hc->retired_size)
+	{
+		size = (hc->retired_size > 0) ? hc->retired_size * 2 : 16;
+		if((p = (HashRetired *)realloc(hc->retired, sizeof(*p) * size))
+				== NULL)
+		{
+			/* leaking is safer than releasing too early */
+			pthread_mutex_unlock(&hc->mutex);
+			return error_set_code(-errno, "%s", strerror(errno));
+		}
+		hc->retired = p;
+		hc->retired_size = size;
+	}
+	p = &hc->retired[hc->retired_cnt++];
+	p->data = data;
+	p->release = release;
+	pthread_mutex_unlock(&hc->mutex);
+	return 0;
+}
+
+
+/* hash_unshare */
+int hash_unshare(Hash * hash)
+{
+	if(hash->concurrent != NULL)
+		return 0;
+	return _hash_unshare(hash);
+}
+
+
+/* private */
+/* functions */
+/* hash_hash */
+static unsigned int _hash_hash(Hash const * hash, void const * key)
+{
+	uint64_t h;
+
+	if(hash->func_seed != NULL)
+	{
+		h = hash->func_seed(key, hash->seed);
+		return h ^ (h >> 32);
+	}
+	return (hash->func != NULL) ? hash->func(key) : 0;
+}
+
+
+/* hash_destroy */
+static void _hash_destroy(Hash const * hash, HashTable * table)
+{
+	/* the last copy releases the entries */
+	if(!_hashtable_unref(table))
+		return;
+	_hash_release(hash, table);
+	_hashtable_free(table);
+}
+
+
+/* hash_release */
+static void _hash_release(Hash const * hash, HashTable const * table)
 {
-	Array const * entries = (Array const *)hash->entries;
-	unsigned int h;
 	size_t i;
 	HashEntry const * he;
 
-	h = (hash->func != NULL) ? hash->func(key) : 0;
-	for(i = array_count(entries); i > 0; i--)
+	if(hash->key_release == NULL && hash->value_release == NULL)
+		return;
+	for(i = 0; i < table->entries_cnt; i++)
 	{
-		if((he = (HashEntry const *)array_get(entries, i - 1)) == NULL)
-			return NULL;
-		if(he->hash != h)
+		if((he = &table->entries[i])->value == NULL)
 			continue;
-		if(hash->compare(he->key, key) == 0)
-			return he->key;
+		if(hash->key_release != NULL)
+			hash->key_release(he->key);
+		if(hash->value_release != NULL)
+			hash->value_release(he->value);
 	}
-	error_set_code(1, "%s", "Key not found");
-	return NULL;
 }
 
 
-/* hash_set */
-int hash_set(Hash * hash, void const * key, void * value)
+/* hash_retain */
+static int _hash_retain(Hash const * hash, HashTable * table)
 {
-	Array * entries = (Array *)hash->entries;
-	unsigned int h;
 	size_t i;
-	size_t cnt;
-	HashEntry he;
-	HashEntry * p;
+	HashEntry * he;
+	void const * key;
+	void * value;
 
-	h = (hash->func != NULL) ? hash->func(key) : 0;
-	for(i = 0, cnt = array_count(entries); i < cnt; i++)
+	if(hash->key_retain == NULL && hash->value_retain == NULL)
+		return 0;
+	for(i = 0; i < table->entries_cnt; i++)
 	{
-		if((p = (HashEntry *)array_get(entries, i)) == NULL)
-			return 1;
-		if(p->hash != h)
+		if((he = &table->entries[i])->value == NULL)
 			continue;
-		if(hash->compare(p->key, key) != 0)
+		key = he->key;
+		value = he->value;
+		if(hash->key_retain != NULL
+				&& (key = hash->key_retain(he->key)) == NULL)
+			break;
+		if(hash->value_retain != NULL
+				&& (value = hash->value_retain(he->value))
+				== NULL)
+		{
+			if(hash->key_retain != NULL)
+				hash->key_release(key);
+			break;
+		}
+		he->key = key;
+		he->value = value;
+	}
+	if(i == table->entries_cnt)
+		return 0;
+	/* release the entries retained so far */
+	while(i-- > 0)
+	{
+		if((he = &table->entries[i])->value == NULL)
 			continue;
-		if(value == NULL)
-			return (array_remove_pos(entries, i) == 0) ? 0 : 1;
-		return _hashentry_set_value(p, value);
+		if(hash->key_retain != NULL)
+			hash->key_release(he->key);
+		if(hash->value_retain != NULL)
+			hash->value_release(he->value);
 	}
-	if(value == NULL)
+	return -1;
+}
+
+
+/* hash_unshare */
+static int _hash_unshare(Hash * hash)
+{
+	HashTable copy;
+
+	if(!_hashtable_is_shared(&hash->table))
 		return 0;
-	_hashentry_init(&he, hash->func, key, value);
-	return (array_append(entries, &he) == 0) ? 0 : 1;
+	/* leave the entries and buckets to the other copies */
+	if(_hashtable_init_copy(&copy, &hash->table, false) != 0)
+		return -1;
+	if(_hash_retain(hash, &copy) != 0)
+	{
+		_hashtable_destroy(&copy);
+		return -1;
+	}
+	_hash_destroy(hash, &hash->table);
+	hash->table = copy;
+	if(copy.entries == copy.small)
+		hash->table.entries = hash->table.small;
+	return 0;
 }
 
 
-/* useful */
-/* hash_foreach */
-static void _hash_foreach(void * value, void * data);
+/* hash_read_begin */
+static HashTable const * _hash_read_begin(Hash const * hash,
+		unsigned int * epoch)
+{
+	HashConcurrent * hc = hash->concurrent;
+
+	*epoch = 0;
+	if(hc == NULL)
+		return &hash->table;
+	/* register as a reader before looking at the current table */
+	*epoch = atomic_load(&hc->epoch) & 1;
+	atomic_fetch_add(&hc->readers[*epoch], 1);
+	return atomic_load(&hc->table);
+}
 
-struct funcdata
+
+/* hash_read_end */
+static void _hash_read_end(Hash const * hash, unsigned int epoch)
 {
-	Hash const * hash;
-	HashForeach func;
-	void * data;
-};
+	HashConcurrent * hc = hash->concurrent;
 
-void hash_foreach(Hash const * hash, HashForeach func, void * data)
+	if(hc != NULL)
+		atomic_fetch_sub(&hc->readers[epoch], 1);
+}
+
+
+/* hash_write_begin */
+static HashTable * _hash_write_begin(Hash * hash)
 {
-	Array const * entries = (Array const *)hash->entries;
-	struct funcdata fd;
+	HashConcurrent * hc = hash->concurrent;
+	HashTable * table;
 
-	fd.hash = hash;
-	fd.func = func;
-	fd.data = data;
-	array_foreach(entries, _hash_foreach, &fd);
+	if(hc == NULL)
+		return (_hash_unshare(hash) == 0) ? &hash->table : NULL;
+	if((table = (HashTable *)object_new(sizeof(*table))) == NULL)
+		return NULL;
+	pthread_mutex_lock(&hc->mutex);
+	/* do not move the entries, for the sake of iterators */
+	if(_hashtable_init_copy(table, atomic_load(&hc->table), false) != 0)
+	{
+		pthread_mutex_unlock(&hc->mutex);
+		object_delete(table);
+		return NULL;
+	}
+	return table;
 }
 
-static void _hash_foreach(void * value, void * data)
+
+/* hash_write_end */
+static int _hash_write_end(Hash * hash, HashTable * table, int ret,
+		bool release)
 {
-	HashEntry * he = (HashEntry *)value;
-	struct funcdata * fd = (struct funcdata *)data;
+	HashConcurrent * hc = hash->concurrent;
+	unsigned int i;
+	unsigned int epoch;
 
-	fd->func(fd->hash, he->key, he->value, fd->data);
+	if(hc == NULL)
+		return ret;
+	if(ret == 0)
+	{
+		table = atomic_exchange(&hc->table, table);
+		/* wait for the readers of the former table, in both epochs as
+		 * some may have registered before the last change */
+		for(i = 0; i < 2; i++)
+		{
+			epoch = atomic_fetch_add(&hc->epoch, 1) & 1;
+			while(atomic_load(&hc->readers[epoch]) != 0)
+				sched_yield();
+		}
+	}
+	pthread_mutex_unlock(&hc->mutex);
+	/* the entries are otherwise still in use by the new table */
+	if(ret == 0 && release)
+		_hash_release(hash, table);
+	_hashtable_destroy(table);
+	object_delete(table);
+	return ret;
 }
 
 
-/* hash_reset */
-int hash_reset(Hash * hash)
+/* hash_release_retired */
+static void _hash_release_retired(Hash * hash)
 {
-	Array * entries = (Array *)hash->entries;
+	HashConcurrent * hc = hash->concurrent;
+	HashRetired * retired;
+	size_t cnt;
+	size_t i;
 
-	while(array_count(entries))
-		if(array_remove_pos(entries, 0) != 0)
-			return 1;
-	return 0;
+	pthread_mutex_lock(&hc->mutex);
+	retired = hc->retired;
+	cnt = hc->retired_cnt;
+	hc->retired = NULL;
+	hc->retired_cnt = 0;
+	hc->retired_size = 0;
+	pthread_mutex_unlock(&hc->mutex);
+	for(i = 0; i < cnt; i++)
+		retired[i].release(retired[i].data);
+	free(retired);
 }
@@ -28,6 +28,7 @@
 
 
 
+#include <stdbool.h>
 #include <stddef.h>
 #include "System/error.h"
 #include "System/hash.h"
@@ -36,26 +37,75 @@
 
 
 /* Mutator */
+/* private */
+/* prototypes */
+static int _mutator_compare_interned(void const * value1, void const * value2);
+static bool _mutator_is_interned(Mutator const * mutator);
+
+static String * _mutator_key_new(Mutator const * mutator, String const * key);
+static void _mutator_key_delete(Mutator const * mutator, String * key);
+
+static void * _mutator_key_retain(void const * key);
+static void * _mutator_key_retain_interned(void const * key);
+static void _mutator_key_release(void const * key);
+static void _mutator_key_release_interned(void const * key);
+
+
 /* public */
 /* functions */
 /* mutator_new */
 Mutator * mutator_new(void)
 {
-	return hash_new(hash_func_string, hash_compare_string);
+	Mutator * mutator;
+
+	if((mutator = hash_new(hash_func_string, hash_compare_string)) == NULL)
+		return NULL;
+	hash_set_key_ownership(mutator, _mutator_key_retain,
+			_mutator_key_release);
+	return mutator;
+}
+
+
+/* mutator_new_concurrent */
+Mutator * mutator_new_concurrent(void)
+{
+	Mutator * mutator;
+
+	if((mutator = hash_new_concurrent(hash_func_string,
+					hash_compare_string)) == NULL)
+		return NULL;
+	hash_set_key_ownership(mutator, _mutator_key_retain,
+			_mutator_key_release);
+	return mutator;
 }
 
 
 /* mutator_new_copy */
 Mutator * mutator_new_copy(Mutator const * from)
 {
+	/* the keys are duplicated only once either mutator is modified */
 	return hash_new_copy(from);
 }
 
 
+/* mutator_new_interned */
+Mutator * mutator_new_interned(void)
+{
+	Mutator * mutator;
+
+	if((mutator = hash_new(hash_func_string, _mutator_compare_interned))
+			== NULL)
+		return NULL;
+	hash_set_key_ownership(mutator, _mutator_key_retain_interned,
+			_mutator_key_release_interned);
+	return mutator;
+}
+
+
 /* mutator_delete */
 void mutator_delete(Mutator * mutator)
 {
-	mutator_reset(mutator);
+	/* the keys are freed along with the last copy */
 	hash_delete(mutator);
 }
 
@@ -71,46 +121,102 @@ size_t mutator_count(Mutator const * mutator)
 /* mutator_get */
 void * mutator_get(Mutator const * mutator, String const * key)
 {
-	void * ret;
+	return mutator_get_prehashed(mutator, key, hash_get_hash(mutator, key));
+}
+
+
+/* mutator_get_prehashed */
+void * mutator_get_prehashed(Mutator const * mutator, String const * key,
+		unsigned int h)
+{
+	void * ret = NULL;
+	String const * k = key;
 
-	if((ret = hash_get(mutator, key)) == NULL)
-		error_set("%s: %s", key, "Key not found");
-	return ret;
+	/* keys never interned cannot be found */
+	if((!_mutator_is_interned(mutator)
+				|| (k = string_intern_find(key)) != NULL)
+			&& (ret = hash_get_prehashed(mutator, k, h)) != NULL)
+		return ret;
+	error_set("%s: %s", key, "Key not found");
+	return NULL;
+}
+
+
+/* mutator_get_stats */
+static void _get_stats_foreach(Mutator const * mutator, String const * key,
+		void * value, void * data);
+
+void mutator_get_stats(Mutator const * mutator, HashStats * stats)
+{
+	hash_get_stats(mutator, stats);
+	/* interned strings are owned by string_intern(), and not accounted
+	 * for */
+	if(!_mutator_is_interned(mutator))
+		mutator_foreach(mutator, _get_stats_foreach, stats);
+}
+
+static void _get_stats_foreach(Mutator const * mutator, String const * key,
+		void * value, void * data)
+{
+	HashStats * stats = (HashStats *)data;
+	(void) mutator;
+	(void) value;
+
+	stats->size += string_get_size(key);
 }
 
 
 /* mutator_set */
 int mutator_set(Mutator * mutator, String const * key, void * value)
+{
+	return mutator_set_prehashed(mutator, key, hash_get_hash(mutator, key),
+			value);
+}
+
+
+/* mutator_set_prehashed */
+int mutator_set_prehashed(Mutator * mutator, String const * key,
+		unsigned int h, void * value)
 {
 	int ret;
-	String * k;
-	String * oldk;
+	String * k = NULL;
+	String const * oldk;
 
-	/* look for the former key */
-	if((oldk = (String *)hash_get_key(mutator, key)) == NULL)
+	if(_mutator_is_interned(mutator))
 	{
-		if(value == NULL)
-			/* there is nothing to do */
+		/* compare the keys by address */
+		if(value != NULL)
+		{
+			if((k = (String *)string_intern(key)) == NULL)
+				return -1;
+			key = k;
+		}
+		else if((key = string_intern_find(key)) == NULL)
+			/* there is nothing to remove */
 			return 0;
-		/* allocate the new key */
-		if((k = string_new(key)) == NULL)
-			return -1;
-		key = k;
 	}
-	else
+	else if(value != NULL && (hash_is_concurrent(mutator)
+				|| hash_get_key_prehashed(mutator, key, h)
+				== NULL))
 	{
-		if(value != NULL)
-			oldk = NULL;
-		k = NULL;
+		/* allocate the new key, as it may be missing once locked */
+		if((k = _mutator_key_new(mutator, key)) == NULL)
+			return -1;
+		key = k;
 	}
-	if((ret = hash_set(mutator, key, value)) != 0)
+	/* look for the former key while holding the lock */
+	if((ret = hash_set_key_prehashed(mutator, key, h, value,
+					(void const **)&oldk)) != 0)
 	{
 		error_set("%s: %s", key, "Could not set the value");
-		string_delete(k);
+		_mutator_key_delete(mutator, k);
 	}
-	else
+	else if(value == NULL)
 		/* free the former key if removed */
-		string_delete(oldk);
+		_mutator_key_delete(mutator, (String *)oldk);
+	else if(oldk != NULL)
+		/* the former key was kept */
+		_mutator_key_delete(mutator, k);
 	return ret;
 }
 
@@ -122,24 +228,81 @@ void mutator_foreach(Mutator const * mutator, MutatorForeach func, void * data)
 }
 
 
-/* mutator_reset */
-static void _reset_foreach(Mutator const * mutator, String const * key,
-		void * value, void * data);
+/* mutator_reserve */
+int mutator_reserve(Mutator * mutator, size_t count)
+{
+	return hash_reserve(mutator, count);
+}
+
 
+/* mutator_reset */
 int mutator_reset(Mutator * mutator)
 {
-	/* free the keys */
-	mutator_foreach(mutator, _reset_foreach, NULL);
+	/* the keys are freed along with the last copy */
 	return hash_reset(mutator);
 }
 
-static void _reset_foreach(Mutator const * mutator, String const * key,
-		void * value, void * data)
+
+/* private */
+/* functions */
+/* mutator_compare_interned */
+static int _mutator_compare_interned(void const * value1, void const * value2)
 {
-	String * k = (String *)key;
-	(void) mutator;
-	(void) value;
-	(void) data;
+	/* interned keys are equal if and only if they are the same */
+	return (value1 == value2) ? 0 : 1;
+}
+
+
+/* mutator_is_interned */
+static bool _mutator_is_interned(Mutator const * mutator)
+{
+	return (hash_get_compare(mutator) == _mutator_compare_interned)
+		? true : false;
+}
+
+
+/* mutator_key_new */
+static String * _mutator_key_new(Mutator const * mutator, String const * key)
+{
+	if(_mutator_is_interned(mutator))
+		return (String *)string_intern(key);
+	return string_new(key);
+}
+
+
+/* mutator_key_delete */
+static void _mutator_key_delete(Mutator const * mutator, String * key)
+{
+	if(_mutator_is_interned(mutator))
+		string_intern_release(key);
+	else
+		string_delete(key);
+}
+
+
+/* mutator_key_retain */
+static void * _mutator_key_retain(void const * key)
+{
+	return string_new((String const *)key);
+}
 
-	string_delete(k);
+
+/* mutator_key_retain_interned */
+static void * _mutator_key_retain_interned(void const * key)
+{
+	return (void *)string_intern((String const *)key);
+}
+
+
+/* mutator_key_release */
+static void _mutator_key_release(void const * key)
+{
+	string_delete((String *)key);
+}
+
+
+/* mutator_key_release_interned */
+static void _mutator_key_release_interned(void const * key)
+{
+	string_intern_release((String const *)key);
 }
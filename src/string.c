@@ -28,8 +28,10 @@
 
 
 
+#include <pthread.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -37,10 +39,30 @@
 #include <errno.h>
 #include "System/error.h"
 #include "System/object.h"
+#include "System/hash.h"
 #include "System/string.h"
 
 
 /* String */
+/* private */
+/* types */
+typedef struct _StringAtom
+{
+	size_t refcount;
+	char string[];
+} StringAtom;
+
+
+/* variables */
+/* the interned strings, by value */
+static Hash * _string_atoms = NULL;
+static pthread_mutex_t _string_atoms_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* prototypes */
+static int _string_compare_atom(void const * value1, void const * value2);
+
+
 /* public */
 /* string_new */
 String * string_new(String const * string)
@@ -340,11 +362,13 @@ static void _explose_foreach_delete(ArrayData * value, void * data);
 StringArray * string_explode(String const * string, String const * separator)
 {
 	StringArray * ret;
-	String * p;			/* temporary pointer */
+	String ** p;			/* current element */
 	size_t i;			/* current position */
 	String const * s;		/* &string[i] */
 	ssize_t j;			/* position of the next separator */
 	ssize_t l;
+	size_t k;			/* current element */
+	size_t count;
 
 #ifdef DEBUG
 	fprintf(stderr, "DEBUG: %s(\"%s\", \"%s\")\n", __func__, string,
@@ -358,36 +382,36 @@ StringArray * string_explode(String const * string, String const * separator)
 		array_delete(ret);
 		return NULL;
 	}
-	for(i = 0;; i += j + l)
+	/* allocate every element at once */
+	for(i = 0, count = 1; (j = string_index(&string[i], separator)) >= 0;
+			i += j + l)
+		count++;
+	if(array_resize(ret, count) != 0)
+	{
+		array_delete(ret);
+		return NULL;
+	}
+	for(i = 0, k = 0;; i += j + l, k++)
 	{
 		s = &string[i];
 		j = string_index(s, separator);
 #ifdef DEBUG
 		fprintf(stderr, "DEBUG: %s(): i=%zu, j=%zd\n", __func__, i, j);
 #endif
+		p = stringarray_get_mutable(ret, k);
 		if(j < 0)
 		{
-			if((p = string_new(s)) == NULL
-					|| array_append(ret, p) != 0)
-			{
-				string_delete(p);
+			if((*p = string_new(s)) == NULL)
 				break;
-			}
 #ifdef DEBUG
-			fprintf(stderr, "DEBUG: %s(): \"%s\"\n", __func__,
-					ret[ret_cnt - 1]);
+			fprintf(stderr, "DEBUG: %s(): \"%s\"\n", __func__, *p);
 #endif
 			return ret;
 		}
-		if((p = string_new_length(s, j)) == NULL
-				|| array_append(ret, p) != 0)
-		{
-			string_delete(p);
+		if((*p = string_new_length(s, j)) == NULL)
 			break;
-		}
 #ifdef DEBUG
-		fprintf(stderr, "DEBUG: %s(): \"%s\"\n", __func__,
-				ret[ret_cnt - 1]);
+		fprintf(stderr, "DEBUG: %s(): \"%s\"\n", __func__, *p);
 #endif
 	}
 	/* free everything */
@@ -398,10 +422,10 @@ StringArray * string_explode(String const * string, String const * separator)
 
 static void _explose_foreach_delete(ArrayData * value, void * data)
 {
-	String * s = (String *)value;
+	String ** s = (String **)value;
 	(void) data;
 
-	string_delete(s);
+	string_delete(*s);
 }
 
 
@@ -435,6 +459,97 @@ ssize_t string_index(String const * string, String const * key)
 }
 
 
+/* string_intern */
+String const * string_intern(String const * string)
+{
+	StringAtom * atom;
+	unsigned int h;
+	String const * p;
+	size_t len;
+
+	if(string == NULL)
+	{
+		error_set_code(-EINVAL, "%s", strerror(EINVAL));
+		return NULL;
+	}
+	pthread_mutex_lock(&_string_atoms_mutex);
+	if(_string_atoms == NULL && (_string_atoms = hash_new(hash_func_string,
+					_string_compare_atom)) == NULL)
+	{
+		pthread_mutex_unlock(&_string_atoms_mutex);
+		return NULL;
+	}
+	/* look for the atom without setting any error */
+	h = hash_get_hash(_string_atoms, string);
+	if((p = (String const *)hash_get_key_prehashed(_string_atoms, string, h))
+			!= NULL)
+	{
+		atom = (StringAtom *)(p - offsetof(StringAtom, string));
+		atom->refcount++;
+		pthread_mutex_unlock(&_string_atoms_mutex);
+		return atom->string;
+	}
+	len = string_get_length(string);
+	if((atom = (StringAtom *)object_new(sizeof(*atom) + len + 1)) == NULL)
+	{
+		pthread_mutex_unlock(&_string_atoms_mutex);
+		return NULL;
+	}
+	atom->refcount = 1;
+	memcpy(atom->string, string, len + 1);
+	if(hash_set_prehashed(_string_atoms, atom->string, h, atom) != 0)
+	{
+		object_delete(atom);
+		atom = NULL;
+	}
+	pthread_mutex_unlock(&_string_atoms_mutex);
+	return (atom != NULL) ? atom->string : NULL;
+}
+
+
+/* string_intern_find */
+String const * string_intern_find(String const * string)
+{
+	String const * ret = NULL;
+
+	if(string == NULL)
+	{
+		error_set_code(-EINVAL, "%s", strerror(EINVAL));
+		return NULL;
+	}
+	pthread_mutex_lock(&_string_atoms_mutex);
+	if(_string_atoms != NULL)
+		ret = (String const *)hash_get_key_prehashed(_string_atoms,
+				string, hash_get_hash(_string_atoms, string));
+	pthread_mutex_unlock(&_string_atoms_mutex);
+	return ret;
+}
+
+
+/* string_intern_release */
+void string_intern_release(String const * string)
+{
+	StringAtom * atom;
+
+	if(string == NULL)
+		return;
+	atom = (StringAtom *)(string - offsetof(StringAtom, string));
+	pthread_mutex_lock(&_string_atoms_mutex);
+	if(--atom->refcount == 0)
+	{
+		hash_set(_string_atoms, atom->string, NULL);
+		object_delete(atom);
+		/* release the table along with the last atom */
+		if(hash_count(_string_atoms) == 0)
+		{
+			hash_delete(_string_atoms);
+			_string_atoms = NULL;
+		}
+	}
+	pthread_mutex_unlock(&_string_atoms_mutex);
+}
+
+
 /* string_ltrim */
 size_t string_ltrim(String * string, String const * which)
 {
@@ -571,3 +686,14 @@ size_t string_trim(String * string, String const * which)
 {
 	return string_ltrim(string, which) + string_rtrim(string, which);
 }
+
+
+/* private */
+/* functions */
+/* string_compare_atom */
+static int _string_compare_atom(void const * value1, void const * value2)
+{
+	if(value1 == value2)
+		return 0;
+	return string_compare((String const *)value1, (String const *)value2);
+}
@@ -34,6 +34,7 @@
 #include <string.h>
 #include <errno.h>
 #include "System/error.h"
+#include "System/hash.h"
 #include "System/mutator.h"
 #include "System/object.h"
 #include "System/variable.h"
@@ -74,14 +75,6 @@ struct _Variable
 	} u;
 };
 
-typedef struct _VariableCompoundCallbackData
-{
-	size_t * size;
-	char * result;
-	size_t pos;
-	int ret;
-} VariableCompoundCallbackData;
-
 
 /* constants */
 static const size_t _variable_sizes[VT_COUNT] = { 0, 1,
@@ -149,20 +142,32 @@ Variable * variable_new_array(VariableType type, size_t size, ...)
 Variable * variable_new_arrayv(VariableType type, size_t size, va_list ap)
 {
 	Variable * variable;
+	Array * array;
+	size_t s;
 	size_t i;
-	void * p;
 
-	if((variable = variable_new(VT_ARRAY, type, size)) == NULL)
+	s = (type < sizeof(_variable_sizes) / sizeof(*_variable_sizes))
+		? _variable_sizes[type] : 0;
+	if(s == 0)
+	{
+		error_set_code(-EINVAL, "%s", strerror(EINVAL));
 		return NULL;
-	for(i = 0; i < size; i++)
+	}
+	if((array = array_new(s)) == NULL)
+		return NULL;
+	/* allocate every element at once */
+	if(array_resize(array, size) != 0
+			|| (variable = (Variable *)object_new(
+					sizeof(*variable))) == NULL)
 	{
-		p = va_arg(ap, void *);
-		if(array_set(variable->u.array.array, i, p) != 0)
-		{
-			variable_delete(variable);
-			return NULL;
-		}
+		array_delete(array);
+		return NULL;
 	}
+	for(i = 0; i < size; i++)
+		memcpy(array_get_mutable(array, i), va_arg(ap, void *), s);
+	variable->type = VT_ARRAY;
+	variable->u.array.type = type;
+	variable->u.array.array = array;
 	return variable;
 }
 
@@ -225,6 +230,11 @@ Variable * variable_new_compound_variables(String const * name, size_t members,
 	if((variable = variable_new(VT_COMPOUND, name)) == NULL)
 		return NULL;
 	m = variable->u.compound.members;
+	if(mutator_reserve(m, members) != 0)
+	{
+		variable_delete(variable);
+		return NULL;
+	}
 	for(i = 0; i < members; i++)
 	{
 		if(names[i] == NULL)
@@ -303,10 +313,8 @@ Variable * variable_new_copy(Variable const * from)
 static Variable * _new_copy_array(Variable const * from)
 {
 	Variable * variable;
-	size_t size;
 
-	size = array_get_size(from->u.array.array);
-	if((variable = variable_new_array(from->u.array.type, size)) == NULL)
+	if((variable = variable_new_array(from->u.array.type, 0)) == NULL)
 		return NULL;
 	if(array_copy(variable->u.array.array, from->u.array.array) != 0)
 	{
@@ -325,6 +333,11 @@ static Variable * _new_copy_compound(Variable const * from)
 			== NULL)
 		return NULL;
 	m = variable->u.compound.members;
+	if(mutator_reserve(m, mutator_count(from->u.compound.members)) != 0)
+	{
+		variable_delete(variable);
+		return NULL;
+	}
 	mutator_foreach(from->u.compound.members, _new_copy_compound_foreach,
 			&m);
 	if(m == NULL)
@@ -549,8 +562,6 @@ void variable_delete(Variable * variable)
 /* variable_get_as */
 static VariableError _get_as_compound(Variable const * variable, void * result,
 		size_t * size);
-static void _get_as_compound_callback(Mutator const * mutator,
-		String const * key, void * value, void * data);
 static VariableError _get_as_convert(Variable const * variable,
 		VariableType type, void * result);
 static VariableError _get_as_convert_string(Variable const * variable,
@@ -625,39 +636,29 @@ VariableError variable_get_as(Variable const * variable, VariableType type,
 static VariableError _get_as_compound(Variable const * variable, void * result,
 		size_t * size)
 {
-	VariableCompoundCallbackData data;
+	VariableError ret = 0;
+	char * p = result;
+	size_t pos = 0;
+	HashIterator iterator;
+	Variable const * from;
+	size_t s;
+	int res;
 
 	if(size == NULL)
 		return error_set_code(-EINVAL, "%s", strerror(EINVAL));
-	data.size = size;
-	data.pos = 0;
-	data.result = result;
-	data.ret = 0;
-	/* XXX there is no warranty on the right order */
-	mutator_foreach(variable->u.compound.members,
-			_get_as_compound_callback, &data);
-	return data.ret;
-}
-
-static void _get_as_compound_callback(Mutator const * mutator,
-		String const * key, void * value, void * data)
-{
-	VariableCompoundCallbackData * vccd = data;
-	Variable const * from = value;
-	VariableType type;
-	size_t size;
-	int res;
-	(void) mutator;
-	(void) key;
-
-	/* XXX assumes alignment on byte boundary */
-	type = variable_get_type(from);
-	size = *(vccd->size);
-	size = (size >= vccd->pos) ? size - vccd->pos : 0;
-	if((res = variable_get_as(from, type, &vccd->result[vccd->pos], &size))
-			!= 0)
-		vccd->ret = res;
-	vccd->pos += size;
+	/* the members are packed in the order they were defined */
+	for(hash_iter_begin(variable->u.compound.members, &iterator);
+			hash_iter_next(&iterator);)
+	{
+		from = (Variable const *)hash_iter_value(&iterator);
+		/* XXX assumes alignment on byte boundary */
+		s = (*size >= pos) ? *size - pos : 0;
+		if((res = variable_get_as(from, variable_get_type(from),
+						&p[pos], &s)) != 0)
+			ret = res;
+		pos += s;
+	}
+	return ret;
 }
 
 static VariableError _get_as_convert(Variable const * variable,
@@ -1383,6 +1384,12 @@ static VariableError _copy_compound(Variable * variable, Variable const * from)
 		string_delete(s);
 		return -1;
 	}
+	if(mutator_reserve(m, mutator_count(from->u.compound.members)) != 0)
+	{
+		mutator_delete(m);
+		string_delete(s);
+		return -1;
+	}
 	mutator_foreach(from->u.compound.members, _copy_compound_foreach, &n);
 	if(n == NULL)
 	{
@@ -1498,6 +1505,10 @@ VariableError variable_serialize(Variable * variable, Buffer * buffer,
 			break;
 		case VT_ARRAY:
 			array = variable->u.array.array;
+			/* the serialized format is limited to 32-bit */
+			if(array_count(array) > UINT32_MAX)
+				return error_set_code(-ERANGE, "%s",
+						strerror(ERANGE));
 			size = sizeof(u32);
 			u32 = array_count(array);
 			u32 = _bswap32(u32);
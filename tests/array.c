@@ -28,6 +28,7 @@
 
 
 
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include "System/array.h"
@@ -39,6 +40,7 @@
 
 ARRAY(int)
 ARRAY2(unsigned int, UnsignedInt)
+ARRAY2(unsigned long long, UnsignedLongLong)
 
 
 /* test */
@@ -46,6 +48,15 @@ static bool _test_filter(void * value, void * data);
 static bool _test_filter_swap(void * data, void * value);
 static void _test_foreach(void * value, void * data);
 static void _test_foreach_swap(void * data, void * value);
+static int _test_accessors(void);
+static int _test_copy(void);
+static int _test_parallel(size_t count, unsigned int nthreads);
+static void _test_parallel_foreach(void * value, void * data);
+static void _test_parallel_map(void const * value, void * result,
+		void * data);
+static int _test_sort(size_t count, unsigned int seed);
+static int _test_sort_compare(void const * value1, void const * value2);
+static int _test_sort_compare_key(void const * value1, void const * value2);
 
 static int _test(intArray * array)
 {
@@ -53,6 +64,7 @@ static int _test(intArray * array)
 	int j;
 	int * p;
 	intArray * a;
+	int values[3] = { 7, 8, 9 };
 
 	if(array_get(array, 0) != NULL
 			|| array_get_copy(array, 0, &i) == 0)
@@ -60,7 +72,9 @@ static int _test(intArray * array)
 	i = 0;
 	if(array_set(array, 0, &i) != 0)
 		return 3;
-	if(array_set(array, SIZE_MAX, NULL) == 0)
+	if(array_set(array, SIZE_MAX, NULL) == 0
+			|| array_set(array, SIZE_MAX / sizeof(i) + 1, &i) == 0
+			|| array_count(array) != 1)
 		return 4;
 	i = 0xffffffff;
 	if(array_get_copy(array, 0, &i) != 0 || i != 0)
@@ -75,6 +89,8 @@ static int _test(intArray * array)
 			return 8;
 	if(array_count(array) != 1024)
 		return 9;
+	if(array_get_capacity(array) < 1024)
+		return 19;
 	if((p = (int *)array_get(array, 512)) == NULL || *p != 512)
 		return 10;
 	j = 0;
@@ -100,7 +116,72 @@ static int _test(intArray * array)
 	array_filter_swap(array, _test_filter_swap, NULL);
 	if(array_count(array) != 0)
 		return 18;
-	return 0;
+	/* capacity */
+	if(array_shrink_to_fit(array) != 0 || array_get_capacity(array) != 0)
+		return 20;
+	if(array_reserve(array, 100) != 0 || array_get_capacity(array) != 100
+			|| array_count(array) != 0)
+		return 21;
+	for(i = 0; i < 101; i++)
+		if(array_append(array, &i) != 0)
+			return 22;
+	if(array_get_capacity(array) < 101 || array_reserve(array, 50) != 0
+			|| array_get_capacity(array) < 101)
+		return 23;
+	if((p = (int *)array_get(array, 100)) == NULL || *p != 100)
+		return 24;
+	if(array_reserve(array, SIZE_MAX) == 0)
+		return 25;
+	/* ranges */
+	if(array_remove_range(array, 10, 90) != 0 || array_count(array) != 11
+			|| (p = (int *)array_get(array, 10)) == NULL
+			|| *p != 100)
+		return 26;
+	if(array_remove_range(array, 10, 2) == 0
+			|| array_remove_range(array, 12, 0) == 0)
+		return 27;
+	if(array_insert_n(array, 1, values, 3) != 0
+			|| array_append_n(array, values, 3) != 0
+			|| array_count(array) != 17)
+		return 28;
+	for(i = 0; i < 3; i++)
+		if(*(int *)array_get(array, i + 1) != values[i]
+				|| *(int *)array_get(array, i + 14)
+				!= values[i])
+			return 29;
+	if(*(int *)array_get(array, 0) != 0 || *(int *)array_get(array, 4) != 1)
+		return 30;
+	if(array_insert_n(array, 18, values, 1) == 0)
+		return 31;
+	/* resizing */
+	if(array_resize(array, 4) != 0 || array_count(array) != 4
+			|| array_resize(array, 8) != 0
+			|| array_count(array) != 8
+			|| *(int *)array_get(array, 3) != values[2]
+			|| *(int *)array_get(array, 4) != 0
+			|| *(int *)array_get(array, 7) != 0)
+		return 32;
+	if(array_resize(array, 0) != 0 || array_count(array) != 0)
+		return 33;
+	/* partition */
+	for(i = 0; i < 100; i++)
+	{
+		j = i % 3;
+		if(array_append(array, &j) != 0)
+			return 34;
+	}
+	if((a = array_partition(array, _test_filter, NULL)) == NULL)
+		return 35;
+	if(array_count(array) != 66 || array_count(a) != 34)
+		j = 36;
+	else
+		for(i = 0, j = 0; i < 66; i++)
+			if(*(int *)array_get(array, i) != (i % 2) + 1
+					|| (i < 34 && *(int *)array_get(a, i)
+						!= 0))
+				j = 37;
+	array_delete(a);
+	return j;
 }
 
 static bool _test_filter(void * value, void * data)
@@ -133,6 +214,277 @@ static void _test_foreach_swap(void * data, void * value)
 }
 
 
+/* test_accessors */
+static int _test_accessors(void)
+{
+	int ret = 0;
+	UnsignedIntArray * array;
+	unsigned int i;
+	unsigned int j;
+	unsigned int const * p;
+	size_t count;
+	ArrayView view;
+
+	if((array = UnsignedIntarray_new()) == NULL)
+		return 2;
+	if(UnsignedIntarray_data(array) != NULL
+			|| UnsignedIntarray_get_copy(array, 0, &i) == 0)
+		ret = 50;
+	array_get_view(array, &view);
+	if(ret == 0 && (array_get_data(array, &count) != NULL || count != 0
+				|| view.data != NULL || view.count != 0
+				|| view.size != sizeof(i)))
+		ret = 54;
+	for(i = 0; ret == 0 && i < 100; i++)
+		if(UnsignedIntarray_append(array, i) != 0)
+			ret = 51;
+	if(ret == 0 && (UnsignedIntarray_set(array, 10, 1000) != 0
+				|| UnsignedIntarray_set(array, 100, 100) != 0
+				|| UnsignedIntarray_get_copy(array, 10, &j) != 0
+				|| j != 1000 || *UnsignedIntarray_get(array, 100)
+				!= 100 || UnsignedIntarray_get(array, 101) != NULL))
+		ret = 52;
+	if(ret == 0 && (p = UnsignedIntarray_data(array)) != NULL)
+	{
+		for(i = 0, j = 0; i < array_count(array); i++)
+			j += p[i];
+		if(j != 4950 - 10 + 1000 + 100)
+			ret = 53;
+	}
+	array_get_view(array, &view);
+	if(ret == 0 && (array_get_data(array, &count) != view.data
+				|| count != 101 || view.count != 101
+				|| ((unsigned int const *)view.data)[100]
+				!= 100))
+		ret = 55;
+	array_delete(array);
+	return ret;
+}
+
+
+/* test_sort */
+static int _test_copy(void)
+{
+	int ret = 0;
+	UnsignedIntArray * array;
+	UnsignedIntArray * copy;
+	UnsignedIntArray * copy2;
+	unsigned int i;
+	unsigned int * p;
+
+	if((array = UnsignedIntarray_new()) == NULL)
+		return 2;
+	for(i = 0; ret == 0 && i < 100; i++)
+		if(UnsignedIntarray_append(array, i) != 0)
+			ret = 70;
+	if(ret != 0 || (copy = array_new_copy(array)) == NULL)
+	{
+		array_delete(array);
+		return (ret != 0) ? ret : 2;
+	}
+	/* the storage is shared until modified */
+	if(array_get_data(copy, NULL) != array_get_data(array, NULL)
+			|| array_count(copy) != 100)
+		ret = 71;
+	else if(UnsignedIntarray_set(copy, 10, 1000) != 0
+			|| array_get_data(copy, NULL)
+			== array_get_data(array, NULL)
+			|| *UnsignedIntarray_get(copy, 10) != 1000
+			|| *UnsignedIntarray_get(array, 10) != 10
+			|| *UnsignedIntarray_get(copy, 99) != 99)
+		ret = 72;
+	else if((copy2 = array_new_copy(array)) == NULL)
+		ret = 2;
+	else
+	{
+		/* either side may diverge first */
+		if(UnsignedIntarray_append(array, 100) != 0
+				|| array_count(array) != 101
+				|| array_count(copy2) != 100
+				|| array_remove_pos(copy2, 0) != 0
+				|| *UnsignedIntarray_get(copy2, 0) != 1
+				|| *UnsignedIntarray_get(array, 0) != 0)
+			ret = 73;
+		array_delete(array);
+		array = copy2;
+		if(ret == 0 && (array_copy(copy, array) != 0
+					|| array_get_data(copy, NULL)
+					!= array_get_data(array, NULL)
+					|| array_count(copy) != 99))
+			ret = 74;
+		array_sort(array, _test_sort_compare);
+		if(ret == 0 && (array_resize(copy, 10) != 0
+					|| array_count(array) != 99
+					|| *UnsignedIntarray_get(array, 98)
+					!= 99))
+			ret = 75;
+	}
+	/* writing through a pointer unshares the storage first */
+	if(ret == 0 && (array_copy(copy, array) != 0
+				|| (p = UnsignedIntarray_get_mutable(copy, 0))
+				== NULL || (*p = 1000) != 1000
+				|| *UnsignedIntarray_get(array, 0) == 1000
+				|| UnsignedIntarray_data_mutable(array)
+				== UnsignedIntarray_data(copy)))
+		ret = 76;
+	array_delete(copy);
+	array_delete(array);
+	return ret;
+}
+
+
+static int _test_parallel(size_t count, unsigned int nthreads)
+{
+	int ret = 0;
+	UnsignedIntArray * array;
+	UnsignedLongLongArray * squares;
+	unsigned int i;
+	unsigned int const * p;
+	unsigned long long const * q;
+	pthread_t self = pthread_self();
+
+	if((array = UnsignedIntarray_new()) == NULL)
+		return 2;
+	if((squares = UnsignedLongLongarray_new()) == NULL)
+	{
+		array_delete(array);
+		return 2;
+	}
+	for(i = 0; ret == 0 && i < count; i++)
+		if(UnsignedIntarray_append(array, i) != 0)
+			ret = 60;
+	if(ret == 0)
+	{
+		/* small arrays are handled by the calling thread alone */
+		array_foreach_parallel(array, _test_parallel_foreach,
+				(count < 2048) ? &self : NULL, nthreads);
+		p = UnsignedIntarray_data(array);
+		for(i = 0; i < count; i++)
+			if(p[i] != i * 2)
+				ret = 61;
+	}
+	if(ret == 0 && (array_map_parallel(squares, array, _test_parallel_map,
+					NULL, nthreads) != 0
+				|| array_count(squares) != count))
+		ret = 62;
+	if(ret == 0 && (q = UnsignedLongLongarray_data(squares)) != NULL)
+		for(i = 0; i < count; i++)
+			if(q[i] != (unsigned long long)i * i * 4)
+				ret = 63;
+	if(ret == 0 && array_map(array, array, _test_parallel_map, NULL) == 0)
+		ret = 64;
+	array_delete(squares);
+	array_delete(array);
+	return ret;
+}
+
+static void _test_parallel_foreach(void * value, void * data)
+{
+	unsigned int * u = (unsigned int *)value;
+	pthread_t const * self = (pthread_t const *)data;
+
+	if(self != NULL && !pthread_equal(*self, pthread_self()))
+		*u = 1;
+	else
+		*u *= 2;
+}
+
+static void _test_parallel_map(void const * value, void * result,
+		void * data)
+{
+	unsigned int const * u = (unsigned int const *)value;
+	unsigned long long * r = (unsigned long long *)result;
+	(void) data;
+
+	*r = (unsigned long long)*u * *u;
+}
+
+
+static int _test_sort(size_t count, unsigned int seed)
+{
+	int ret = 0;
+	intArray * array;
+	size_t i;
+	unsigned int j;
+	int k;
+	int const * p;
+
+	if((array = intarray_new()) == NULL)
+		return 2;
+	/* keys with duplicates, pseudo-random unless the seed is 0, with the
+	 * index in the low bits */
+	for(i = 0, j = seed; i < count && ret == 0; i++)
+	{
+		j = (seed != 0) ? j * 1103515245 + 12345 : (count - i) << 16;
+		k = (((j >> 16) % 64) << 16) | i;
+		ret = array_append(array, &k);
+	}
+	if(ret != 0)
+		ret = 2;
+	/* array_sort_stable */
+	else if(array_sort_stable(array, _test_sort_compare_key) != 0)
+		ret = 40;
+	else
+		for(i = 1; i < count; i++)
+			if(*(int *)array_get(array, i - 1)
+					>= *(int *)array_get(array, i))
+				ret = 41;
+	/* array_sort */
+	if(ret == 0)
+	{
+		array_sort(array, _test_sort_compare);
+		for(i = 1; i < count; i++)
+			if(*(int *)array_get(array, i - 1)
+					> *(int *)array_get(array, i))
+				ret = 42;
+	}
+	/* array_bsearch, array_lower_bound, array_insert_sorted */
+	if(ret == 0 && count > 0)
+	{
+		k = *(int *)array_get(array, count / 2);
+		if((p = array_bsearch(array, &k, _test_sort_compare)) == NULL
+				|| *p != k)
+			ret = 43;
+		else if(array_lower_bound(array, &k, _test_sort_compare)
+				> count / 2)
+			ret = 44;
+		k = -1;
+		if(array_bsearch(array, &k, _test_sort_compare) != NULL
+				|| array_lower_bound(array, &k,
+					_test_sort_compare) != 0)
+			ret = 45;
+		k = INT32_MAX;
+		if(array_insert_sorted(array, &k, _test_sort_compare) != 0
+				|| *(int *)array_get(array, count) != k)
+			ret = 46;
+		k = 0;
+		if(array_insert_sorted(array, &k, _test_sort_compare) != 0
+				|| *(int *)array_get(array, 0) != k)
+			ret = 47;
+	}
+	array_delete(array);
+	return ret;
+}
+
+static int _test_sort_compare(void const * value1, void const * value2)
+{
+	int const * i = (int const *)value1;
+	int const * j = (int const *)value2;
+
+	return (*i < *j) ? -1 : ((*i > *j) ? 1 : 0);
+}
+
+static int _test_sort_compare_key(void const * value1, void const * value2)
+{
+	int const * i = (int const *)value1;
+	int const * j = (int const *)value2;
+
+	/* compare the keys only, the order of the indexes must remain */
+	return ((*i >> 16) < (*j >> 16)) ? -1
+		: (((*i >> 16) > (*j >> 16)) ? 1 : 0);
+}
+
+
 /* main */
 int main(void)
 {
@@ -146,5 +498,15 @@ int main(void)
 	if((ret = _test(array)) != 0)
 		error_print(PROGNAME);
 	array_delete(array);
+	if(ret == 0 && (ret = _test_accessors()) == 0
+			&& (ret = _test_copy()) == 0
+			&& (ret = _test_parallel(10, 0)) == 0
+			&& (ret = _test_parallel(2047, 7)) == 0
+			&& (ret = _test_parallel(100000, 0)) == 0
+			&& (ret = _test_parallel(100000, 7)) == 0
+			&& (ret = _test_sort(0, 1)) == 0
+			&& (ret = _test_sort(10, 1)) == 0
+			&& (ret = _test_sort(10000, 1)) == 0)
+		ret = _test_sort(10000, 0);
 	return ret;
 }
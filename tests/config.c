@@ -46,7 +46,9 @@ static int _test(char const * progname, String const * filename,
 {
 	int ret = 0;
 	Config * config;
+	Config * copy;
 	String const * value;
+	HashStats stats;
 
 	if((config = config_new()) == NULL)
 		return -error_print(progname);
@@ -58,6 +60,36 @@ static int _test(char const * progname, String const * filename,
 		config_delete(config);
 		return -error_print(progname);
 	}
+	/* config_get_stats */
+	printf("%s: Testing %s\n", progname, "config_get_stats()");
+	fflush(stdout);
+	config_get_stats(config, &stats);
+	if(stats.size == 0 || (stats.count > 0 && (stats.probe_max == 0
+					|| stats.load <= 0.0)))
+		ret = -error_set_print(progname, 1, "%s", "Invalid statistics");
+	/* config_new_copy */
+	printf("%s: Testing %s\n", progname, "config_new_copy()");
+	fflush(stdout);
+	if((copy = config_new_copy(config)) == NULL)
+		ret = -error_print(progname);
+	else if(expected == NULL)
+		config_delete(copy);
+	else
+	{
+		if(config_set(copy, NULL, variable, "copy") != 0)
+			ret = -error_print(progname);
+		if((value = config_get(config, NULL, variable)) == NULL
+				|| string_compare(expected, value) != 0)
+			ret = -error_set_print(progname, 1, "%s: %s",
+					"config_new_copy()",
+					"Original modified");
+		if((value = config_get(copy, NULL, variable)) == NULL
+				|| string_compare("copy", value) != 0)
+			ret = -error_set_print(progname, 1, "%s: %s",
+					"config_new_copy()",
+					"Copy not modified");
+		config_delete(copy);
+	}
 	/* config_get */
 	printf("%s: Testing %s\n", progname, "config_get()");
 	fflush(stdout);
@@ -0,0 +1,117 @@
+/* $Id$ */
+/* Copyright (c) 2026 Pierre Pronchery <khorben@defora.org> */
+/* This file is part of DeforaOS System libSystem */
+/* All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include "System/deque.h"
+#include "System/error.h"
+
+#ifndef PROGNAME
+# define PROGNAME	"deque"
+#endif
+
+DEQUE(int)
+
+
+/* test */
+static int _test(intDeque * deque)
+{
+	int i;
+	int j;
+	int * p;
+
+	if(deque_count(deque) != 0 || deque_get(deque, 0) != NULL
+			|| deque_get_front(deque) != NULL
+			|| deque_get_back(deque) != NULL
+			|| deque_get_copy(deque, 0, &i) == 0)
+		return 2;
+	if(intdeque_pop_front(deque, &i) == 0
+			|| intdeque_pop_back(deque, &i) == 0)
+		return 3;
+	/* fill from both ends */
+	for(i = 0; i < 100; i++)
+		if(intdeque_push_back(deque, i) != 0
+				|| intdeque_push_front(deque, -i - 1) != 0)
+			return 4;
+	if(deque_count(deque) != 200 || deque_get_capacity(deque) < 200)
+		return 5;
+	for(i = 0; i < 200; i++)
+		if((p = intdeque_get(deque, i)) == NULL || *p != i - 100)
+			return 6;
+	if(*(int *)deque_get_front(deque) != -100
+			|| *(int *)deque_get_back(deque) != 99
+			|| deque_get_copy(deque, 150, &j) != 0 || j != 50)
+		return 7;
+	/* drain from both ends */
+	for(i = 0; i < 50; i++)
+		if(intdeque_pop_front(deque, &j) != 0 || j != i - 100
+				|| intdeque_pop_back(deque, &j) != 0
+				|| j != 99 - i)
+			return 8;
+	if(deque_count(deque) != 100 || deque_pop_front(deque, NULL) != 0
+			|| *intdeque_get(deque, 0) != -49)
+		return 9;
+	/* wrap around without growing, then grow */
+	for(i = 0; i < 1000; i++)
+		if(intdeque_push_back(deque, i) != 0
+				|| intdeque_pop_front(deque, NULL) != 0)
+			return 10;
+	for(i = 0; i < 1000; i++)
+		if(intdeque_push_front(deque, i) != 0)
+			return 11;
+	for(i = 0; i < 1000; i++)
+		if(intdeque_pop_front(deque, &j) != 0 || j != 999 - i)
+			return 12;
+	for(i = 0; i < 99; i++)
+		if(intdeque_pop_front(deque, &j) != 0 || j != 901 + i)
+			return 13;
+	if(deque_count(deque) != 0)
+		return 14;
+	deque_clear(deque);
+	if(deque_reserve(deque, 5000) != 0 || deque_get_capacity(deque) < 5000
+			|| deque_reserve(deque, SIZE_MAX) == 0)
+		return 15;
+	return 0;
+}
+
+
+/* main */
+int main(void)
+{
+	int ret;
+	intDeque * deque;
+
+	if((deque = intdeque_new()) == NULL)
+		return 2;
+	if((ret = _test(deque)) != 0)
+		error_print(PROGNAME);
+	deque_delete(deque);
+	return ret;
+}
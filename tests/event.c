@@ -28,7 +28,10 @@
 
 
 
+#include <unistd.h>
 #include <stdio.h>
+#include <string.h>
+#include "System/error.h"
 #include "System/event.h"
 
 
@@ -50,6 +53,272 @@ static int _event(char const * progname)
 	return ret;
 }
 
+
+/* event_handle */
+typedef struct _EventHandleTest
+{
+	Event * event;
+	char fired[8];
+	unsigned int count;
+	EventHandle * handle;
+} EventHandleTest;
+
+typedef struct _EventHandleTestData
+{
+	EventHandleTest * eht;
+	char id;
+} EventHandleTestData;
+
+static int _event_handle_on_again(int fd, void * data);
+static int _event_handle_on_cancel(int fd, void * data);
+static int _event_handle_on_fail(int fd, void * data);
+static int _event_handle_on_quit(int fd, void * data);
+static int _event_handle_on_read(int fd, void * data);
+static int _event_handle_on_timeout(void * data);
+
+static int _event_handle_io(char const * progname, char const * backend);
+
+static int _event_handle(char const * progname)
+{
+	int ret = -1;
+	EventHandleTest eht;
+	EventHandleTestData data[3] = { { &eht, 'a' }, { &eht, 'b' },
+		{ &eht, 'c' } };
+	EventHandle * handles[3];
+	EventHandle * handle;
+	struct timeval tv;
+	int fds[2];
+	size_t i;
+
+	printf("%s: Testing event_cancel()\n", progname);
+	memset(&eht, 0, sizeof(eht));
+	if((eht.event = event_new()) == NULL)
+		return -1;
+	if(pipe(fds) != 0)
+	{
+		event_delete(eht.event);
+		return -1;
+	}
+	/* the timeouts share the same callback */
+	for(i = 0; i < sizeof(handles) / sizeof(*handles); i++)
+	{
+		tv.tv_sec = 0;
+		tv.tv_usec = (i + 1) * 10000;
+		handles[i] = event_add_timeout(eht.event, &tv,
+				_event_handle_on_timeout, &data[i]);
+	}
+	tv.tv_usec = 1000;
+	if(handles[0] != NULL && handles[1] != NULL && handles[2] != NULL
+			&& (handle = event_add_io_read(eht.event, fds[0],
+					_event_handle_on_read, &eht)) != NULL
+			&& event_cancel(eht.event, handle) == 0
+			&& write(fds[1], "", 1) == 1
+			&& event_cancel(eht.event, handles[0]) == 0
+			&& event_set_timeout(eht.event, handles[2], &tv) == 0)
+		ret = event_loop(eht.event);
+	if(ret == 0 && strcmp(eht.fired, "cb") != 0)
+		ret = -1;
+	event_delete(eht.event);
+	close(fds[0]);
+	close(fds[1]);
+	return ret;
+}
+
+static int _event_handle_io(char const * progname, char const * backend)
+{
+	int ret = -1;
+	EventHandleTest eht;
+	EventHandle * handle;
+	int fds[2];
+
+	printf("%s: Testing event_set_io(\"%s\")\n", progname, backend);
+	memset(&eht, 0, sizeof(eht));
+	if((eht.event = event_new_backend(backend)) == NULL)
+	{
+		/* only select is available on every platform */
+		if(strcmp(backend, "select") == 0)
+			return -1;
+		printf("%s: Skipping event_set_io(\"%s\"): %s\n", progname,
+				backend, error_get(NULL));
+		return 0;
+	}
+	if(pipe(fds) != 0)
+	{
+		event_delete(eht.event);
+		return -1;
+	}
+	/* the watchers share the descriptor, which remains readable: the
+	 * first one is removed, the second one cancels itself and the third
+	 * one keeps running */
+	if(write(fds[1], "", 1) == 1
+			&& event_add_io_read(eht.event, fds[0],
+				_event_handle_on_fail, &eht) != NULL
+			&& (eht.handle = event_add_io_read(eht.event, fds[0],
+					_event_handle_on_cancel, &eht)) != NULL
+			&& (handle = event_add_io_read(eht.event, fds[0],
+					_event_handle_on_quit, &eht)) != NULL
+			&& event_loop(eht.event) == 0
+			&& strcmp(eht.fired, "abc") == 0
+			&& event_set_io(eht.event, handle,
+				_event_handle_on_again, &eht) == 0
+			&& event_loop(eht.event) == 0
+			&& strcmp(eht.fired, "abcq") == 0
+			&& event_cancel(eht.event, handle) == 0)
+		ret = 0;
+	event_delete(eht.event);
+	close(fds[0]);
+	close(fds[1]);
+	return ret;
+}
+
+static int _event_handle_on_again(int fd, void * data)
+{
+	EventHandleTest * eht = (EventHandleTest *)data;
+	(void) fd;
+
+	eht->fired[eht->count++] = 'q';
+	event_loop_quit(eht->event);
+	return 0;
+}
+
+static int _event_handle_on_cancel(int fd, void * data)
+{
+	EventHandleTest * eht = (EventHandleTest *)data;
+	(void) fd;
+
+	eht->fired[eht->count++] = 'b';
+	event_cancel(eht->event, eht->handle);
+	return 0;
+}
+
+static int _event_handle_on_fail(int fd, void * data)
+{
+	EventHandleTest * eht = (EventHandleTest *)data;
+	(void) fd;
+
+	eht->fired[eht->count++] = 'a';
+	return 1;
+}
+
+static int _event_handle_on_quit(int fd, void * data)
+{
+	EventHandleTest * eht = (EventHandleTest *)data;
+	(void) fd;
+
+	eht->fired[eht->count++] = 'c';
+	event_loop_quit(eht->event);
+	return 0;
+}
+
+static int _event_handle_on_read(int fd, void * data)
+{
+	EventHandleTest * eht = (EventHandleTest *)data;
+	(void) fd;
+
+	eht->fired[eht->count++] = 'r';
+	event_loop_quit(eht->event);
+	return 1;
+}
+
+static int _event_handle_on_timeout(void * data)
+{
+	EventHandleTestData * ehtd = (EventHandleTestData *)data;
+	EventHandleTest * eht = ehtd->eht;
+
+	eht->fired[eht->count++] = ehtd->id;
+	if(eht->count == 2)
+		event_loop_quit(eht->event);
+	return 1;
+}
+
+
+/* event_io */
+typedef struct _EventIOTest
+{
+	Event * event;
+	int fds[2];
+	unsigned int reads;
+	unsigned int peeks;
+	unsigned int writes;
+} EventIOTest;
+
+static int _event_io_on_peek(int fd, void * data);
+static int _event_io_on_read(int fd, void * data);
+static int _event_io_on_write(int fd, void * data);
+
+static int _event_io(char const * progname, char const * backend)
+{
+	int ret;
+	EventIOTest eit;
+
+	printf("%s: Testing event_new_backend(\"%s\")\n", progname, backend);
+	memset(&eit, 0, sizeof(eit));
+	if((eit.event = event_new_backend(backend)) == NULL)
+	{
+		/* only select is available on every platform */
+		if(strcmp(backend, "select") == 0)
+			return -1;
+		printf("%s: Skipping event_new_backend(\"%s\"): %s\n",
+				progname, backend, error_get(NULL));
+		return 0;
+	}
+	if(strcmp(event_get_backend(eit.event), backend) != 0
+			|| pipe(eit.fds) != 0)
+	{
+		event_delete(eit.event);
+		return -1;
+	}
+	if(event_register_io_read(eit.event, eit.fds[0], _event_io_on_read,
+				&eit) != 0
+			|| event_register_io_read(eit.event, eit.fds[0],
+				_event_io_on_peek, &eit) != 0
+			|| event_register_io_write(eit.event, eit.fds[1],
+				_event_io_on_write, &eit) != 0)
+		ret = -1;
+	else
+		ret = event_loop(eit.event);
+	/* every byte written must have been read exactly once, and the
+	 * second watcher still notified when the first one is removed */
+	if(ret == 0 && (eit.writes != 3 || eit.reads != 3 || eit.peeks != 3))
+		ret = -1;
+	event_delete(eit.event);
+	close(eit.fds[0]);
+	close(eit.fds[1]);
+	return ret;
+}
+
+static int _event_io_on_peek(int fd, void * data)
+{
+	EventIOTest * eit = (EventIOTest *)data;
+	(void) fd;
+
+	eit->peeks++;
+	return 0;
+}
+
+static int _event_io_on_read(int fd, void * data)
+{
+	EventIOTest * eit = (EventIOTest *)data;
+	char c;
+
+	if(read(fd, &c, sizeof(c)) != sizeof(c))
+		return 1;
+	if(++eit->reads < 3)
+		return 0;
+	event_loop_quit(eit->event);
+	return 1;
+}
+
+static int _event_io_on_write(int fd, void * data)
+{
+	EventIOTest * eit = (EventIOTest *)data;
+	char c = 'a';
+
+	if(write(fd, &c, sizeof(c)) != sizeof(c))
+		return 1;
+	return (++eit->writes < 3) ? 0 : 1;
+}
+
 static int _event_on_idle(void * data)
 {
 	Event * event = (Event *)data;
@@ -59,10 +328,117 @@ static int _event_on_idle(void * data)
 }
 
 
+/* event_timeout */
+typedef struct _EventTimeoutTest
+{
+	Event * event;
+	unsigned int fired[3];
+	unsigned int count;
+	unsigned int never;
+} EventTimeoutTest;
+
+typedef struct _EventTimeoutTestData
+{
+	EventTimeoutTest * ett;
+	unsigned int id;
+} EventTimeoutTestData;
+
+static int _event_timeout_on_timeout(void * data);
+static int _event_timeout_on_never(void * data);
+
+static int _event_timeout(char const * progname)
+{
+	int ret = 0;
+	EventTimeoutTest ett;
+	EventTimeoutTestData data[3];
+	/* registered out of order on purpose */
+	unsigned int const delays[3] = { 30000, 10000, 20000 };
+	/* the second one is registered late */
+	unsigned int const late[3] = { 10000, 5000, 20000 };
+	struct timeval tv;
+	size_t i;
+
+	printf("%s: Testing event_register_timeout()\n", progname);
+	memset(&ett, 0, sizeof(ett));
+	if((ett.event = event_new()) == NULL)
+		return -1;
+	for(i = 0; i < sizeof(data) / sizeof(*data); i++)
+	{
+		data[i].ett = &ett;
+		data[i].id = i;
+		tv.tv_sec = 0;
+		tv.tv_usec = delays[i];
+		if(event_register_timeout(ett.event, &tv,
+					_event_timeout_on_timeout, &data[i])
+				!= 0)
+			ret = -1;
+	}
+	tv.tv_usec = 15000;
+	if(event_register_timeout(ett.event, &tv, _event_timeout_on_never,
+				&ett) != 0
+			|| event_unregister_timeout(ett.event,
+				_event_timeout_on_never) != 0)
+		ret = -1;
+	if(ret == 0)
+		ret = event_loop(ett.event);
+	if(ret == 0 && (ett.count != 3 || ett.never != 0
+				|| ett.fired[0] != 1 || ett.fired[1] != 2
+				|| ett.fired[2] != 0))
+		ret = -1;
+	/* timeouts registered outside of the loop start from the current
+	 * time */
+	ett.count = 0;
+	for(i = 0; ret == 0 && i < sizeof(data) / sizeof(*data); i++)
+	{
+		if(i == 1)
+			usleep(20000);
+		tv.tv_usec = late[i];
+		if(event_register_timeout(ett.event, &tv,
+					_event_timeout_on_timeout, &data[i])
+				!= 0)
+			ret = -1;
+	}
+	if(ret == 0)
+		ret = event_loop(ett.event);
+	if(ret == 0 && (ett.count != 3 || ett.fired[0] != 0
+				|| ett.fired[1] != 1 || ett.fired[2] != 2))
+		ret = -1;
+	event_delete(ett.event);
+	return ret;
+}
+
+static int _event_timeout_on_timeout(void * data)
+{
+	EventTimeoutTestData * ettd = (EventTimeoutTestData *)data;
+	EventTimeoutTest * ett = ettd->ett;
+
+	ett->fired[ett->count++] = ettd->id;
+	if(ett->count == 3)
+		event_loop_quit(ett->event);
+	return 1;
+}
+
+static int _event_timeout_on_never(void * data)
+{
+	EventTimeoutTest * ett = (EventTimeoutTest *)data;
+
+	ett->never++;
+	return 1;
+}
+
+
 /* main */
 int main(int argc, char * argv[])
 {
+	int ret = 0;
 	(void) argc;
 
-	return (_event(argv[0]) == 0) ? 0 : 2;
+	ret |= _event(argv[0]);
+	ret |= _event_timeout(argv[0]);
+	ret |= _event_handle(argv[0]);
+	ret |= _event_handle_io(argv[0], "select");
+	ret |= _event_handle_io(argv[0], "epoll");
+	ret |= _event_io(argv[0], "select");
+	ret |= _event_io(argv[0], "epoll");
+	return (ret == 0) ? 0 : 2;
 }
@@ -0,0 +1,386 @@
+/* $Id$ */
+/* Copyright (c) 2021 Pierre Pronchery <khorben@defora.org> */
+/* This file is part of DeforaOS System libSystem */
+/* All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+
+
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "System/error.h"
+#include "System/string.h"
+#include "System/hash.h"
+
+#ifndef PROGNAME
+# define PROGNAME	"hash"
+#endif
+
+#define KEYS_CNT	4096
+
+
+/* test */
+static void _test_foreach(Hash const * hash, void const * key, void * value,
+		void * data);
+
+static int _test_small(Hash * hash, String ** keys);
+static int _test_stats(String ** keys, size_t count);
+static int _test_concurrent(Hash * hash, String ** keys);
+static void * _test_concurrent_reader(void * data);
+static void _test_concurrent_release(void const * data);
+
+static int _test(Hash * hash, String ** keys)
+{
+	size_t i;
+	size_t j;
+	HashKey hk;
+	HashIterator iterator;
+	HashStats stats;
+	Hash * h;
+
+	/* insertion */
+	for(i = 0; i < KEYS_CNT; i++)
+		if(hash_set(hash, keys[i], keys[i]) != 0)
+			return 2;
+	if(hash_count(hash) != KEYS_CNT)
+		return 3;
+	for(i = 0; i < KEYS_CNT; i++)
+		if(hash_get(hash, keys[i]) != keys[i]
+				|| hash_get_key(hash, keys[i]) != keys[i])
+			return 4;
+	if(hash_get(hash, "nonexistent") != NULL)
+		return 5;
+	/* statistics */
+	hash_get_stats(hash, &stats);
+	if(stats.count != KEYS_CNT || stats.capacity < KEYS_CNT
+			|| stats.load > 0.75 || stats.probe_avg < 1.0
+			|| stats.probe_max < 1 || stats.size == 0
+			|| stats.collisions > KEYS_CNT / 64)
+		return 34;
+	/* prehashed keys */
+	hash_key_init(&hk, hash, keys[2]);
+	if(hk.key != keys[2] || hk.hash != hash_get_hash(hash, keys[2])
+			|| hash_get_prehashed(hash, hk.key, hk.hash) != keys[2]
+			|| hash_set_prehashed(hash, hk.key, hk.hash, keys[3])
+			!= 0 || hash_get(hash, keys[2]) != keys[3]
+			|| hash_set_prehashed(hash, hk.key, hk.hash, keys[2])
+			!= 0 || hash_count(hash) != KEYS_CNT)
+		return 20;
+	/* replacement */
+	if(hash_set(hash, keys[0], keys[1]) != 0
+			|| hash_get(hash, keys[0]) != keys[1]
+			|| hash_count(hash) != KEYS_CNT)
+		return 6;
+	/* removal */
+	for(i = 0; i < KEYS_CNT; i += 2)
+		if(hash_set(hash, keys[i], NULL) != 0)
+			return 7;
+	if(hash_count(hash) != KEYS_CNT / 2)
+		return 8;
+	for(i = 0; i < KEYS_CNT; i++)
+		if((hash_get(hash, keys[i]) != NULL) != ((i % 2) == 1))
+			return 9;
+	j = 0;
+	hash_foreach(hash, _test_foreach, &j);
+	if(j != KEYS_CNT / 2)
+		return 10;
+	/* iteration in insertion order */
+	for(hash_iter_begin(hash, &iterator), i = 1; hash_iter_next(&iterator);
+			i += 2)
+		if(i >= KEYS_CNT || hash_iter_key(&iterator) != keys[i]
+				|| hash_iter_value(&iterator) != keys[i])
+			return 21;
+	if(i != KEYS_CNT + 1)
+		return 22;
+	/* copy */
+	if((h = hash_new_copy(hash)) == NULL)
+		return 11;
+	for(i = 1; i < KEYS_CNT; i += 2)
+		if(hash_get(h, keys[i]) != keys[i])
+		{
+			hash_delete(h);
+			return 12;
+		}
+	/* copy: the copies diverge once modified */
+	if(hash_set(h, keys[1], NULL) != 0 || hash_get(h, keys[1]) != NULL
+			|| hash_get(hash, keys[1]) != keys[1]
+			|| hash_set(hash, keys[3], keys[1]) != 0
+			|| hash_get(h, keys[3]) != keys[3]
+			|| hash_count(h) != KEYS_CNT / 2 - 1
+			|| hash_count(hash) != KEYS_CNT / 2
+			|| hash_set(hash, keys[3], keys[3]) != 0)
+	{
+		hash_delete(h);
+		return 18;
+	}
+	hash_delete(h);
+	/* reset */
+	if(hash_reset(hash) != 0 || hash_count(hash) != 0
+			|| hash_get(hash, keys[1]) != NULL)
+		return 13;
+	for(i = 0; i < KEYS_CNT; i++)
+		if(hash_set(hash, keys[i], keys[i]) != 0)
+			return 14;
+	if(hash_count(hash) != KEYS_CNT)
+		return 15;
+	/* removal while iterating */
+	for(hash_iter_begin(hash, &iterator), i = 0; hash_iter_next(&iterator);
+			i++)
+		if(hash_iter_key(&iterator) != keys[i]
+				|| hash_set(hash, keys[i], NULL) != 0)
+			return 23;
+	if(i != KEYS_CNT || hash_count(hash) != 0)
+		return 24;
+	for(i = 0; i < KEYS_CNT; i++)
+		if(hash_set(hash, keys[i], keys[i]) != 0)
+			return 25;
+	/* reservation */
+	if(hash_reserve(hash, KEYS_CNT * 4) != 0
+			|| hash_count(hash) != KEYS_CNT)
+		return 16;
+	for(i = 0; i < KEYS_CNT; i++)
+		if(hash_get(hash, keys[i]) != keys[i])
+			return 17;
+	return 0;
+}
+
+static void _test_foreach(Hash const * hash, void const * key, void * value,
+		void * data)
+{
+	size_t * i = (size_t *)data;
+
+	if(hash_get(hash, key) == value)
+		(*i)++;
+}
+
+
+static int _test_small(Hash * hash, String ** keys)
+{
+	size_t i;
+	HashIterator iterator;
+
+	/* few keys, removed and added again */
+	for(i = 0; i < 6; i++)
+		if(hash_set(hash, keys[i], keys[i]) != 0)
+			return 2;
+	for(i = 0; i < 6; i += 2)
+		if(hash_set(hash, keys[i], NULL) != 0)
+			return 30;
+	for(i = 6; i < 12; i++)
+		if(hash_set(hash, keys[i], keys[i]) != 0)
+			return 30;
+	if(hash_count(hash) != 9)
+		return 31;
+	for(i = 0; i < 12; i++)
+		if((hash_get(hash, keys[i]) != NULL) != (i >= 6 || (i % 2) == 1))
+			return 32;
+	for(hash_iter_begin(hash, &iterator), i = 1; hash_iter_next(&iterator);
+			i += (i < 5) ? 2 : 1)
+		if(hash_iter_key(&iterator) != keys[i])
+			return 33;
+	return (i == 12) ? 0 : 33;
+}
+
+static int _test_stats(String ** keys, size_t count)
+{
+	int ret = 0;
+	Hash * hash;
+	HashStats stats;
+	size_t i;
+
+	/* every key has the same hash value */
+	if((hash = hash_new(NULL, hash_compare_string)) == NULL)
+		return 2;
+	for(i = 0; i < count; i++)
+		if(hash_set(hash, keys[i], keys[i]) != 0)
+			ret = 2;
+	hash_get_stats(hash, &stats);
+	if(ret == 0 && (stats.count != count || stats.probe_max != count
+				|| stats.collisions != count - 1))
+		ret = 35;
+	/* removed entries are still scanned when the table is small */
+	if(ret == 0 && count <= 8 && hash_set(hash, keys[0], NULL) == 0)
+	{
+		hash_get_stats(hash, &stats);
+		if(stats.count != count - 1 || stats.probe_max != count
+				|| stats.probe_avg != (count + 2) / 2.0)
+			ret = 35;
+	}
+	hash_delete(hash);
+	return ret;
+}
+
+static int _test_concurrent(Hash * hash, String ** keys)
+{
+	int ret = 0;
+	atomic_int done = 0;
+	void * data[3] = { hash, keys, (void *)&done };
+	pthread_t thread;
+	void * res;
+	size_t i;
+	void const * previous;
+	int released = 0;
+	HashStats stats;
+
+	/* the first half of the keys remains while readers are running */
+	for(i = 0; i < KEYS_CNT / 2; i++)
+		if(hash_set(hash, keys[i], keys[i]) != 0)
+			return 2;
+	if(pthread_create(&thread, NULL, _test_concurrent_reader, data) != 0)
+		return 2;
+	for(i = KEYS_CNT / 2; i < KEYS_CNT; i++)
+		if(hash_set(hash, keys[i], keys[i]) != 0)
+			ret = 26;
+	for(i = KEYS_CNT / 2; i < KEYS_CNT; i++)
+		if(hash_set(hash, keys[i], NULL) != 0)
+			ret = 26;
+	atomic_store(&done, 1);
+	if(pthread_join(thread, &res) != 0 || res != NULL)
+		ret = 27;
+	if(ret == 0 && hash_count(hash) != KEYS_CNT / 2)
+		ret = 28;
+	/* the former keys are reported while holding the lock */
+	if(ret == 0 && (hash_set_key_prehashed(hash, keys[1],
+					hash_get_hash(hash, keys[1]), keys[0],
+					&previous) != 0 || previous != keys[1]))
+		ret = 30;
+	if(ret == 0 && (hash_set_key_prehashed(hash, keys[KEYS_CNT - 1],
+					hash_get_hash(hash, keys[KEYS_CNT - 1]),
+					NULL, &previous) != 0
+				|| previous != NULL))
+		ret = 30;
+	/* retired entries survive until the hash is reset */
+	if(ret == 0 && (hash_retire(hash, &released,
+					_test_concurrent_release) != 0
+				|| released != 0))
+		ret = 31;
+	if(ret == 0 && (hash_reset(hash) != 0 || released != 1))
+		ret = 31;
+	/* the capacity reserved survives the next write */
+	if(ret == 0 && (hash_reserve(hash, KEYS_CNT) != 0
+				|| hash_set(hash, keys[0], keys[0]) != 0))
+		ret = 32;
+	hash_get_stats(hash, &stats);
+	if(ret == 0 && stats.capacity < KEYS_CNT)
+		ret = 32;
+	return ret;
+}
+
+static void _test_concurrent_release(void const * data)
+{
+	int * released = (int *)data;
+
+	(*released)++;
+}
+
+static void * _test_concurrent_reader(void * data)
+{
+	void ** d = data;
+	Hash * hash = d[0];
+	String ** keys = d[1];
+	atomic_int * done = d[2];
+	size_t i;
+
+	while(atomic_load(done) == 0)
+		for(i = 0; i < KEYS_CNT / 2; i++)
+			if(hash_get(hash, keys[i]) != keys[i])
+				return hash;
+	return NULL;
+}
+
+
+/* main */
+int main(void)
+{
+	int ret = 2;
+	String * keys[KEYS_CNT];
+	size_t i;
+	Hash * hash;
+
+	if((hash = hash_new(hash_func_string, NULL)) != NULL)
+		return 2;
+	for(i = 0; i < KEYS_CNT; i++)
+		if((keys[i] = string_new_format("key%zu", i)) == NULL)
+			break;
+	if(i == KEYS_CNT && (hash = hash_new_capacity(hash_func_string,
+					hash_compare_string, KEYS_CNT)) != NULL)
+	{
+		ret = _test(hash, keys);
+		hash_delete(hash);
+	}
+	if(ret == 0)
+	{
+		if((hash = hash_new_seed(hash_func_string64, 0x0123456789abcdef,
+						hash_compare_string)) == NULL)
+			ret = 2;
+		else
+		{
+			ret = _test(hash, keys);
+			hash_delete(hash);
+		}
+	}
+	if(ret == 0)
+	{
+		if((hash = hash_new(hash_func_string, hash_compare_string))
+				== NULL)
+			ret = 2;
+		else
+		{
+			ret = _test_small(hash, keys);
+			hash_delete(hash);
+		}
+	}
+	if(ret == 0 && (ret = _test_stats(keys, 5)) == 0)
+		ret = _test_stats(keys, 100);
+	if(ret == 0)
+	{
+		if((hash = hash_new_concurrent(hash_func_string,
+						hash_compare_string)) == NULL)
+			ret = 2;
+		else
+		{
+			if(hash_is_concurrent(hash) != true)
+				ret = 29;
+			else if((ret = _test(hash, keys)) == 0)
+				ret = _test_concurrent(hash, keys);
+			hash_delete(hash);
+		}
+	}
+	/* keys sharing a prefix */
+	if(ret == 0 && hash_func_string("window_width")
+			== hash_func_string("window_height"))
+		ret = 18;
+	if(ret == 0 && hash_func_string64("window_width", 0)
+			== hash_func_string64("window_width", 1))
+		ret = 19;
+	if(ret != 0)
+		error_print(PROGNAME);
+	while(i > 0)
+		string_delete(keys[--i]);
+	return ret;
+}
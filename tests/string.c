@@ -30,6 +30,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include "System/error.h"
 #include "System/string.h"
 
 #ifndef PROGNAME
@@ -46,6 +47,11 @@ static int _test5(String const * string, String const * key, ssize_t expected);
 static int _test6(String const * string, String const * key, ssize_t expected);
 static int _test7(String const * string, size_t length,
 		String const * expected);
+static int _test8(String const * string, String const * expected);
+static int _test9(String const * string, String const * expected);
+static int _test10(String const * string, String const * other);
+static int _test11(String const * string, String const * separator,
+		size_t count, String const * last);
 
 
 /* functions */
@@ -231,6 +237,74 @@ static int _test9(String const * string, String const * expected)
 }
 
 
+/* test10 */
+static int _test10(String const * string, String const * other)
+{
+	int ret = 0;
+	String * s;
+	String const * atom1;
+	String const * atom2;
+	String const * atom3;
+
+	printf("%s: Testing %s\n", PROGNAME, "string_intern()");
+	if((s = string_new(string)) == NULL)
+		return 2;
+	error_set_code(0, "%s", "Untouched");
+	atom1 = string_intern(string);
+	atom2 = string_intern(s);
+	atom3 = string_intern(other);
+	if(atom1 == NULL || atom2 == NULL || atom3 == NULL)
+		ret = 2;
+	/* interning does not report the lookups missed */
+	else if(string_compare(error_get(NULL), "Untouched") != 0)
+	{
+		printf("%s: %s: Test failed\n", PROGNAME, error_get(NULL));
+		ret = 2;
+	}
+	else if(atom1 != atom2 || atom1 == atom3
+			|| string_compare(atom1, string) != 0
+			|| string_compare(atom3, other) != 0
+			|| string_intern_find(s) != atom1
+			|| string_intern_find("never interned") != NULL)
+	{
+		printf("%s: %s, %s: Test failed\n", PROGNAME, string, other);
+		ret = 2;
+	}
+	string_intern_release(atom3);
+	string_intern_release(atom2);
+	string_intern_release(atom1);
+	string_delete(s);
+	return ret;
+}
+
+
+/* test11 */
+static int _test11(String const * string, String const * separator,
+		size_t count, String const * last)
+{
+	int ret = 0;
+	StringArray * array;
+	String ** p;
+	size_t i;
+
+	printf("%s: Testing %s\n", PROGNAME, "string_explode()");
+	if((array = string_explode(string, separator)) == NULL)
+		return 2;
+	if(array_count(array) != count
+			|| (p = (String **)array_get(array, count - 1)) == NULL
+			|| string_compare(*p, last) != 0)
+	{
+		printf("%s: \"%s\", \"%s\": Test failed\n", PROGNAME, string,
+				separator);
+		ret = 2;
+	}
+	for(i = 0; i < array_count(array); i++)
+		string_delete(*(String **)array_get(array, i));
+	array_delete(array);
+	return ret;
+}
+
+
 /* main */
 int main(int argc, char * argv[])
 {
@@ -313,5 +387,12 @@ int main(int argc, char * argv[])
 	/* test9 */
 	ret |= _test9("abcABC", "ABCABC");
 	ret |= _test9("abcABC123", "ABCABC123");
+	/* test10 */
+	ret |= _test10("test", "test2");
+	ret |= _test10("", "test");
+	/* test11 */
+	ret |= _test11("", ",", 1, "");
+	ret |= _test11("a,bc,,d", ",", 4, "d");
+	ret |= _test11("a::b::", "::", 3, "");
 	return ret;
 }
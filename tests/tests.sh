@@ -120,7 +120,7 @@ if [ $# -eq 0 ]; then
 	exit $?
 fi
 
-tests="array buffer config error event includes parser string variable"
+tests="array buffer config deque error event hash includes parser string variable"
 failures=
 $PKGCONFIG --exists "python-2.7"
 case $? in
@@ -49,6 +49,11 @@ static int _variable(char const * progname)
 	double d;
 	Buffer * buf;
 	String * str;
+	int32_t values[3] = { 1, -2, 3 };
+	Variable * v;
+	Array * array;
+	int32_t const * p;
+	int32_t * q;
 
 	/* variable_new */
 	for(i = 0; i < sizeof(samples) / sizeof(*samples); i++)
@@ -111,6 +116,47 @@ static int _variable(char const * progname)
 		ret += 1;
 	}
 	buffer_delete(buf);
+	/* variable_new_array */
+	printf("%s: Testing variable_new_array()\n", progname);
+	if((variable = variable_new_array(VT_INT32, 3, &values[0], &values[1],
+					&values[2])) == NULL
+			|| (v = variable_new_copy(variable)) == NULL)
+	{
+		error_print(progname);
+		ret += 1;
+	}
+	else
+	{
+		size = sizeof(array);
+		if(variable_get_as(v, VT_ARRAY, &array, &size) != 0)
+		{
+			error_print(progname);
+			ret += 1;
+		}
+		else
+		{
+			if(array_count(array) != 3
+					|| (p = array_get_const(array, 1)) == NULL
+					|| *p != -2)
+				ret += 1;
+			/* the copy must not modify the variable */
+			else if((q = array_get_mutable(array, 1)) == NULL
+					|| (*q = 2) != 2)
+				ret += 1;
+			array_delete(array);
+			size = sizeof(array);
+			if(ret == 0 && (variable_get_as(v, VT_ARRAY, &array,
+							&size) != 0
+						|| (p = array_get_const(array, 1))
+						== NULL || *p != -2))
+				ret += 1;
+			if(ret == 0)
+				array_delete(array);
+		}
+		variable_delete(v);
+	}
+	if(variable != NULL)
+		variable_delete(variable);
 	return ret;
 }
 